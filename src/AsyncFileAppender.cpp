@@ -0,0 +1,224 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <sstream>
+
+#include <log4cxx/helpers/loglog.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "AsyncFileAppender.h"
+
+// how often the writer checks for messages on its own (in milliseconds)
+#define LOG_FLUSH_INTERVAL      500
+// how long a blocked message waits for the writer at a time (in milliseconds)
+#define LOG_BLOCK_INTERVAL      10
+#define LOG_MINIMUM_BUFFER      4096
+
+IMPLEMENT_LOG4CXX_OBJECT(AsyncFileAppender)
+
+AsyncFileAppender::AsyncFileAppender()
+  : m_file(-1),
+    m_overflow(LogOverflowDrop),
+    m_buffer(),
+    m_mask(0),
+    m_head(0),
+    m_tail(0),
+    m_dropped(0),
+    m_message(),
+    m_thread(),
+    m_wakeup(),
+    m_space(),
+    m_stop(false)
+{
+  closed = true;
+}
+
+AsyncFileAppender::AsyncFileAppender(const log4cxx::LayoutPtr& layout, const std::string& path,
+                                     size_t bufferSize, LogOverflow overflow)
+  : log4cxx::AppenderSkeleton(layout),
+    m_file(-1),
+    m_overflow(overflow),
+    m_buffer(),
+    m_mask(0),
+    m_head(0),
+    m_tail(0),
+    m_dropped(0),
+    m_message(),
+    m_thread(),
+    m_wakeup(),
+    m_space(),
+    m_stop(false)
+{
+  size_t capacity = LOG_MINIMUM_BUFFER;
+  while (capacity < bufferSize)
+    capacity *= 2;
+  m_buffer.resize(capacity);
+  m_mask = capacity - 1;
+  m_message.reserve(1024);
+
+  m_file = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (m_file < 0)
+  {
+    log4cxx::helpers::LogLog::error("Failed to open " + path + ": " + strerror(errno));
+    closed = true;
+    return;
+  }
+
+  m_thread.setName("AsyncFileAppender");
+  m_thread.start(*this);
+}
+
+AsyncFileAppender::~AsyncFileAppender()
+{
+  finalize();
+}
+
+void AsyncFileAppender::close()
+{
+  if (m_file < 0)
+    return;
+
+  // the writer empties the buffer before it stops
+  __atomic_store_n(&m_stop, true, __ATOMIC_RELEASE);
+  m_wakeup.set();
+  m_thread.join();
+
+  ::close(m_file);
+  m_file = -1;
+  closed = true;
+}
+
+void AsyncFileAppender::append(const log4cxx::spi::LoggingEventPtr& event, log4cxx::helpers::Pool& pool)
+{
+  if (m_file < 0)
+    return;
+
+  // the formatted message is re-used so that its memory only grows once
+  m_message.clear();
+  layout->format(m_message, event, pool);
+#if LOG4CXX_LOGCHAR_IS_UTF8
+  const std::string& message = m_message;
+#else
+  LOG4CXX_ENCODE_CHAR(message, m_message);
+#endif
+
+  const uint64_t size = message.size();
+  const uint64_t capacity = m_mask + 1;
+  const bool important = event->getLevel()->isGreaterOrEqual(log4cxx::Level::getWarn());
+  const bool block = m_overflow == LogOverflowBlock || (m_overflow == LogOverflowKeepWarnings && important);
+  if (size > capacity)
+  {
+    __atomic_add_fetch(&m_dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  // only this thread moves the head, only the writer moves the tail
+  uint64_t tail = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+  while (m_head + size - tail > capacity)
+  {
+    if (!block || __atomic_load_n(&m_stop, __ATOMIC_ACQUIRE))
+    {
+      __atomic_add_fetch(&m_dropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+
+    m_wakeup.set();
+    m_space.tryWait(LOG_BLOCK_INTERVAL);
+    tail = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+  }
+
+  const size_t offset = static_cast<size_t>(m_head & m_mask);
+  const size_t first = std::min(static_cast<size_t>(size), m_buffer.size() - offset);
+  memcpy(&m_buffer[offset], message.data(), first);
+  memcpy(&m_buffer[0], message.data() + first, static_cast<size_t>(size) - first);
+  __atomic_store_n(&m_head, m_head + size, __ATOMIC_RELEASE);
+
+  // the writer batches messages unless the buffer is filling up or the
+  // message shouldn't wait
+  if (important || m_head - tail > capacity / 2)
+    m_wakeup.set();
+}
+
+void AsyncFileAppender::run()
+{
+  // the writer is started before the main thread blocks the signals it
+  // watches, which therefore must never be delivered to this thread
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  while (true)
+  {
+    m_wakeup.tryWait(LOG_FLUSH_INTERVAL);
+    const bool stop = __atomic_load_n(&m_stop, __ATOMIC_ACQUIRE);
+
+    // everything up to the head is written in at most two pieces
+    const uint64_t head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+    if (head != m_tail)
+    {
+      const size_t offset = static_cast<size_t>(m_tail & m_mask);
+      const size_t size = static_cast<size_t>(head - m_tail);
+      const size_t first = std::min(size, m_buffer.size() - offset);
+      write(&m_buffer[offset], first);
+      write(&m_buffer[0], size - first);
+
+      __atomic_store_n(&m_tail, head, __ATOMIC_RELEASE);
+      m_space.set();
+    }
+
+    const uint64_t dropped = __atomic_exchange_n(&m_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0)
+    {
+      std::ostringstream notice;
+      notice << "AsyncFileAppender: dropped " << dropped << " log message(s) because the log file couldn't keep up\n";
+      write(notice.str().c_str(), notice.str().size());
+    }
+
+    if (stop && __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) == m_tail)
+      break;
+  }
+}
+
+void AsyncFileAppender::write(const char* data, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t written = ::write(m_file, data, size);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+    {
+      // there is nowhere else to log to
+      __atomic_add_fetch(&m_dropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+}
@@ -0,0 +1,99 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <log4cxx/appenderskeleton.h>
+#include <log4cxx/helpers/pool.h>
+#include <log4cxx/spi/loggingevent.h>
+
+#include <Poco/Event.h>
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
+
+// what happens to a message when the buffer of the asynchronous appender is
+// full because the writer can't keep up
+typedef enum LogOverflow
+{
+  // the message is dropped
+  LogOverflowDrop = 0,
+  // the logging thread waits until there is room again
+  LogOverflowBlock,
+  // warnings and errors wait, everything else is dropped
+  LogOverflowKeepWarnings
+} LogOverflow;
+
+// formats messages on the logging thread into a bounded single producer /
+// single consumer ring buffer (log4cxx already serializes appending) from
+// which a background thread writes them to the file in batches so that
+// logging never waits for the disk
+class AsyncFileAppender : public log4cxx::AppenderSkeleton, public Poco::Runnable
+{
+  public:
+    DECLARE_LOG4CXX_OBJECT(AsyncFileAppender)
+    BEGIN_LOG4CXX_CAST_MAP()
+      LOG4CXX_CAST_ENTRY(AsyncFileAppender)
+      LOG4CXX_CAST_ENTRY_CHAIN(log4cxx::AppenderSkeleton)
+    END_LOG4CXX_CAST_MAP()
+
+    AsyncFileAppender();
+    AsyncFileAppender(const log4cxx::LayoutPtr& layout, const std::string& path,
+                      size_t bufferSize, LogOverflow overflow);
+    virtual ~AsyncFileAppender();
+
+    bool IsOpen() const { return m_file >= 0; }
+
+    virtual void close();
+    virtual bool requiresLayout() const { return true; }
+
+    virtual void run();
+
+  protected:
+    virtual void append(const log4cxx::spi::LoggingEventPtr& event, log4cxx::helpers::Pool& pool);
+
+  private:
+    AsyncFileAppender(const AsyncFileAppender&);
+    AsyncFileAppender& operator=(const AsyncFileAppender&);
+
+    void write(const char* data, size_t size);
+
+    int m_file;
+    LogOverflow m_overflow;
+
+    // the capacity is a power of two so that positions can be masked, both
+    // positions only ever grow
+    std::vector<char> m_buffer;
+    uint64_t m_mask;
+    uint64_t m_head;
+    uint64_t m_tail;
+    uint64_t m_dropped;
+
+    // only used while appending
+    log4cxx::LogString m_message;
+
+    Poco::Thread m_thread;
+    Poco::Event m_wakeup;
+    Poco::Event m_space;
+    bool m_stop;
+};
+
@@ -0,0 +1,68 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <vector>
+
+#include <stdint.h>
+
+#include <Poco/Timestamp.h>
+
+#include "MachineSet.h"
+
+class Machine;
+class MachineRegistry;
+class ShutdownExecutor;
+
+// is told about every reply while a probe round is still in progress
+class PingObserver
+{
+  public:
+    virtual ~PingObserver() { }
+
+    // the machine at the given index of the round replied, returns true if
+    // the round doesn't need to wait for the remaining replies
+    virtual bool Replied(size_t index) = 0;
+};
+
+// everything the monitor needs to probe, wake up and shut down machines
+class Backend
+{
+  public:
+    virtual ~Backend() { }
+
+    // probes all given machines at once and marks the ones which replied
+    // within the timeout (or until the optional observer ended the round) as
+    // available, returns the number of replies
+    virtual size_t Ping(const MachineRegistry& registry, const std::vector<MachineId>& machines, uint8_t timeout,
+                        MachineSet& available, PingObserver* observer) = 0;
+    // round trip times in microseconds of the last Ping() in the order of its
+    // machines, -1 for the ones which didn't reply
+    virtual const std::vector<Poco::Timestamp::TimeDiff>& GetRoundTrips() const = 0;
+    // number of probes the last Ping() actually sent, machines without an
+    // address or whose probe couldn't be sent aren't counted
+    virtual size_t GetSent() const = 0;
+
+    virtual bool Wake(const Machine& machine) = 0;
+    // shuts the machine down synchronously
+    virtual bool Shutdown(const Machine& machine, uint16_t connectTimeout, uint16_t executeTimeout) = 0;
+    // creates an executor which shuts machines down asynchronously
+    virtual ShutdownExecutor* CreateShutdownExecutor(uint16_t connectTimeout, uint16_t executeTimeout) = 0;
+};
+
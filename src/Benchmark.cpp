@@ -0,0 +1,399 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <log4cxx/logger.h>
+#include <log4cxx/basicconfigurator.h>
+#include <log4cxx/consoleappender.h>
+#include <log4cxx/patternlayout.h>
+
+#include <Poco/NumberFormatter.h>
+#include <Poco/NumberParser.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Clock.h"
+#include "Configuration.h"
+#include "ConfigurationCache.h"
+#include "Metrics.h"
+#include "Monitor.h"
+#include "SimulatedBackend.h"
+
+#define APPLICATION             "home-monitor-benchmark"
+
+#define SECONDS_TO_MICROSECONDS 1000000
+#define MINUTES_TO_MICROSECONDS (60 * static_cast<Poco::Timestamp::TimeDiff>(SECONDS_TO_MICROSECONDS))
+
+// settings of the simulated network
+#define PING_INTERVAL           6
+#define PING_TIMEOUT            2
+#define SERVER_TIMEOUT          60
+#define MACHINE_TIMEOUT         300
+#define BOOT_DELAY              (60 * SECONDS_TO_MICROSECONDS)
+#define SHUTDOWN_DELAY          (10 * SECONDS_TO_MICROSECONDS)
+// a machine stays up for 10 to 60 minutes at a time
+#define SESSION_MINIMUM         10
+#define SESSION_MAXIMUM         60
+
+using namespace std;
+
+// every allocation made by the process is counted
+static uint64_t allocations = 0;
+
+void* operator new(std::size_t size)
+{
+  ++allocations;
+  void* memory = malloc(size != 0 ? size : 1);
+  if (memory == NULL)
+    throw std::bad_alloc();
+
+  return memory;
+}
+
+void operator delete(void* memory) throw()
+{
+  free(memory);
+}
+
+typedef struct Result
+{
+  size_t machines;
+  size_t rounds;
+  // real time and CPU time spent in every round in microseconds
+  std::vector<int64_t> latencies;
+  int64_t cpu;
+  uint64_t allocations;
+
+  uint64_t wakes;
+  uint64_t shutdowns;
+  // shutdowns while a client of the server was up
+  uint64_t wrongShutdowns;
+  // virtual time between a client coming up while the server is down and the
+  // server being up and the other way round, in microseconds
+  std::vector<int64_t> wakeLags;
+  std::vector<int64_t> shutdownLags;
+} Result;
+
+static uint64_t nextRandom(uint64_t& state)
+{
+  // xorshift64
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+static int64_t now(clockid_t clock)
+{
+  struct timespec time;
+  clock_gettime(clock, &time);
+  return static_cast<int64_t>(time.tv_sec) * SECONDS_TO_MICROSECONDS + time.tv_nsec / 1000;
+}
+
+static std::string machineName(size_t index)
+{
+  return "Machine " + Poco::NumberFormatter::format(index);
+}
+
+static bool writeConfiguration(const std::string& path, size_t machines)
+{
+  std::ofstream file(path.c_str());
+  file << "<?xml version=\"1.0\" standalone=\"yes\"?>\n"
+       << "<settings>\n"
+       << "  <network><interface>sim0</interface></network>\n"
+       << "  <ping><interval>" << PING_INTERVAL << "</interval><timeout>" << PING_TIMEOUT << "</timeout></ping>\n"
+       << "  <servers>\n"
+       << "    <server><name>Server</name><mac>02:00:00:00:00:00</mac><ip>10.0.0.1</ip>"
+       << "<username>user</username><password>password</password><timeout>" << SERVER_TIMEOUT << "</timeout></server>\n"
+       << "  </servers>\n"
+       << "  <machines>\n";
+  for (size_t index = 0; index < machines; ++index)
+  {
+    const size_t host = index + 2;
+    file << "    <machine><name>" << machineName(index) << "</name>"
+         << "<mac>02:00:00:" << Poco::NumberFormatter::formatHex((host >> 16) & 0xFF, 2) << ":"
+         << Poco::NumberFormatter::formatHex((host >> 8) & 0xFF, 2) << ":"
+         << Poco::NumberFormatter::formatHex(host & 0xFF, 2) << "</mac>"
+         << "<ip>10." << ((host >> 16) & 0xFF) << "." << ((host >> 8) & 0xFF) << "." << (host & 0xFF) << "</ip>"
+         << "<timeout>" << MACHINE_TIMEOUT << "</timeout></machine>\n";
+  }
+  file << "  </machines>\n"
+       << "</settings>\n";
+
+  return file.good();
+}
+
+static void scriptMachines(SimulatedBackend& backend, size_t machines, Poco::Timestamp::TimeVal start,
+                           Poco::Timestamp::TimeDiff duration, double loss, uint64_t& random)
+{
+  // the longer machines stay down the more of them there are so that about
+  // one of them is up at any time no matter how many there are
+  const Poco::Timestamp::TimeDiff session = (SESSION_MINIMUM + SESSION_MAXIMUM) / 2 * MINUTES_TO_MICROSECONDS;
+  const Poco::Timestamp::TimeDiff pause = 2 * static_cast<Poco::Timestamp::TimeDiff>(machines) * session;
+
+  for (size_t index = 0; index < machines; ++index)
+  {
+    SimulatedHost host;
+    host.up = nextRandom(random) % (machines + 1) == 0;
+    host.roundTrip = 300 + static_cast<Poco::Timestamp::TimeDiff>(nextRandom(random) % 2700);
+    host.jitter = 200;
+    host.loss = loss;
+
+    bool up = host.up;
+    Poco::Timestamp::TimeVal toggle = start;
+    while (toggle < start + duration)
+    {
+      if (up)
+        toggle += (SESSION_MINIMUM + static_cast<Poco::Timestamp::TimeDiff>(nextRandom(random) % (SESSION_MAXIMUM - SESSION_MINIMUM + 1))) * MINUTES_TO_MICROSECONDS;
+      else
+        toggle += 1 + static_cast<Poco::Timestamp::TimeDiff>(nextRandom(random) % static_cast<uint64_t>(pause));
+      host.toggles.push_back(toggle);
+      up = !up;
+    }
+
+    backend.AddHost(machineName(index), host);
+  }
+
+  SimulatedHost server;
+  server.roundTrip = 500;
+  server.jitter = 100;
+  backend.AddHost("Server", server);
+}
+
+static bool run(size_t machines, Poco::Timestamp::TimeDiff duration, double loss, uint64_t seed, Result& result)
+{
+  char path[] = "/tmp/" APPLICATION "-XXXXXX";
+  int descriptor = mkstemp(path);
+  if (descriptor < 0)
+  {
+    cerr << "Failed to create a temporary configuration file" << endl;
+    return false;
+  }
+  close(descriptor);
+
+  Configuration config;
+  bool loaded = writeConfiguration(path, machines) && config.Load(path);
+  unlink(path);
+  unlink(ConfigurationCache::GetPath(path).c_str());
+  if (!loaded)
+  {
+    cerr << "Failed to load the configuration for " << machines << " machines" << endl;
+    return false;
+  }
+
+  const Poco::Timestamp::TimeVal start = Clock::Now().epochMicroseconds();
+  uint64_t random = seed;
+  SimulatedBackend backend(seed);
+  backend.SetPowerDelays(BOOT_DELAY, SHUTDOWN_DELAY);
+  scriptMachines(backend, machines, start, duration, loss, random);
+
+  Metrics metrics;
+  Monitor monitor(config, backend, metrics);
+  backend.Attach(monitor.GetRegistry());
+  if (!monitor.Start())
+  {
+    cerr << "Failed to start the monitor" << endl;
+    return false;
+  }
+
+  // the server is the first machine in the registry, all others are clients
+  const MachineRegistry& registry = monitor.GetRegistry();
+  const MachineId server = 0;
+
+  result.machines = machines;
+  result.rounds = 0;
+  result.latencies.clear();
+  result.cpu = 0;
+  result.allocations = 0;
+  result.wrongShutdowns = 0;
+  result.wakeLags.clear();
+  result.shutdownLags.clear();
+
+  bool wanted = false;
+  bool serverUp = backend.IsUp(server);
+  Poco::Timestamp::TimeVal since = start;
+  const Poco::Timestamp::TimeDiff interval = PING_INTERVAL * SECONDS_TO_MICROSECONDS;
+  for (Poco::Timestamp::TimeVal round = start; round < start + duration; round += interval)
+  {
+    // a round which took longer than the interval delays the next one just
+    // like the ping timer does
+    if (Clock::Now().epochMicroseconds() < round)
+      Clock::Advance(round - Clock::Now().epochMicroseconds());
+
+    // the same sequence the event loop goes through for every ping round,
+    // timeouts between rounds are only noticed at the next round
+    const uint64_t shutdowns = backend.GetShutdowns();
+    const uint64_t allocationsBefore = allocations;
+    const int64_t cpuBefore = now(CLOCK_PROCESS_CPUTIME_ID);
+    const int64_t latencyBefore = now(CLOCK_MONOTONIC);
+
+    monitor.Probe();
+    monitor.Expire();
+    monitor.ShutdownFinished();
+    monitor.Decide();
+
+    result.latencies.push_back(now(CLOCK_MONOTONIC) - latencyBefore);
+    result.cpu += now(CLOCK_PROCESS_CPUTIME_ID) - cpuBefore;
+    result.allocations += allocations - allocationsBefore;
+    ++result.rounds;
+
+    // compare the decisions against what is actually going on
+    bool clientUp = false;
+    for (MachineId id = server + 1; id < registry.GetSize() && !clientUp; ++id)
+      clientUp = backend.IsUp(id);
+    if (backend.GetShutdowns() != shutdowns && clientUp)
+      ++result.wrongShutdowns;
+
+    const Poco::Timestamp::TimeVal current = Clock::Now().epochMicroseconds();
+    const bool up = backend.IsUp(server);
+    if (clientUp != wanted)
+    {
+      wanted = clientUp;
+      since = current;
+    }
+    if (up != serverUp)
+    {
+      serverUp = up;
+      if (up == wanted)
+        (up ? result.wakeLags : result.shutdownLags).push_back(current - since);
+    }
+  }
+
+  result.wakes = backend.GetWakes();
+  result.shutdowns = backend.GetShutdowns();
+  return true;
+}
+
+static void printDurations(std::vector<int64_t> durations, int64_t unit)
+{
+  if (durations.empty())
+  {
+    cout << setw(10) << "-" << setw(10) << "-" << setw(10) << "-";
+    return;
+  }
+
+  std::sort(durations.begin(), durations.end());
+  int64_t sum = 0;
+  for (std::vector<int64_t>::const_iterator duration = durations.begin(); duration != durations.end(); ++duration)
+    sum += *duration;
+
+  cout << setw(10) << sum / static_cast<int64_t>(durations.size()) / unit
+       << setw(10) << durations[durations.size() * 99 / 100] / unit
+       << setw(10) << durations.back() / unit;
+}
+
+void printUsage()
+{
+  cout << APPLICATION " [OPTION]... [MACHINES]..." << endl;
+  cout << "\t-d, --duration HOURS\tSimulate the given number of hours (default 24)." << endl;
+  cout << "\t-l, --loss PERCENT\tLose the given percentage of probes (default 1)." << endl;
+  cout << "\t-r, --seed SEED\tSeed of the simulated timelines (default 1)." << endl;
+  cout << endl;
+  cout << "Runs the presence and power decisions against a simulated network of the given numbers of machines (default 10 100 1000 10000) in virtual time." << endl;
+}
+
+int main(int argc, char** argv)
+{
+  int hours = 24;
+  double loss = 1.0;
+  uint64_t seed = 1;
+  std::vector<size_t> sizes;
+
+  for (int argIndex = 1; argIndex < argc; ++argIndex)
+  {
+    std::string arg(argv[argIndex]);
+    bool valid = true;
+    if ((arg.compare("-d") == 0 || arg.compare("--duration") == 0) && argIndex + 1 < argc)
+      valid = Poco::NumberParser::tryParse(argv[++argIndex], hours) && hours > 0;
+    else if ((arg.compare("-l") == 0 || arg.compare("--loss") == 0) && argIndex + 1 < argc)
+      valid = Poco::NumberParser::tryParseFloat(argv[++argIndex], loss) && loss >= 0.0 && loss <= 100.0;
+    else if ((arg.compare("-r") == 0 || arg.compare("--seed") == 0) && argIndex + 1 < argc)
+    {
+      unsigned int value;
+      valid = Poco::NumberParser::tryParseUnsigned(argv[++argIndex], value) && value != 0;
+      seed = value;
+    }
+    else
+    {
+      unsigned int size;
+      valid = Poco::NumberParser::tryParseUnsigned(arg, size) && size > 0;
+      if (valid)
+        sizes.push_back(size);
+    }
+
+    if (!valid)
+    {
+      printUsage();
+      return 4;
+    }
+  }
+
+  if (sizes.empty())
+  {
+    sizes.push_back(10);
+    sizes.push_back(100);
+    sizes.push_back(1000);
+    sizes.push_back(10000);
+  }
+
+  // only problems are logged so that formatting log messages doesn't distort
+  // the measurements
+  log4cxx::LayoutPtr loggingLayout(new log4cxx::PatternLayout("%-5p [%c] %m%n"));
+  log4cxx::AppenderPtr loggingAppender(new log4cxx::ConsoleAppender(loggingLayout));
+  log4cxx::BasicConfigurator::configure(loggingAppender);
+  log4cxx::Logger::getRootLogger()->setLevel(log4cxx::Level::getWarn());
+
+  Clock::SetVirtual(Poco::Timestamp());
+
+  cout << setw(8) << "machines" << setw(8) << "rounds"
+       << setw(10) << "mean us" << setw(10) << "p99 us" << setw(10) << "max us"
+       << setw(10) << "cpu us" << setw(10) << "allocs"
+       << setw(7) << "wakes" << setw(7) << "shuts" << setw(7) << "wrong"
+       << setw(10) << "wake s" << setw(10) << "p99 s" << setw(10) << "max s"
+       << setw(10) << "shut s" << setw(10) << "p99 s" << setw(10) << "max s" << endl;
+
+  for (std::vector<size_t>::const_iterator size = sizes.begin(); size != sizes.end(); ++size)
+  {
+    Result result;
+    if (!run(*size, static_cast<Poco::Timestamp::TimeDiff>(hours) * 60 * MINUTES_TO_MICROSECONDS, loss / 100.0, seed, result))
+      return 1;
+
+    cout << setw(8) << result.machines << setw(8) << result.rounds;
+    printDurations(result.latencies, 1);
+    cout << setw(10) << result.cpu / static_cast<int64_t>(result.rounds)
+         << setw(10) << result.allocations / result.rounds
+         << setw(7) << result.wakes << setw(7) << result.shutdowns << setw(7) << result.wrongShutdowns;
+    printDurations(result.wakeLags, SECONDS_TO_MICROSECONDS);
+    printDurations(result.shutdownLags, SECONDS_TO_MICROSECONDS);
+    cout << endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Poco/Timestamp.h>
+
+// source of the current time for all presence and power decisions which can
+// be switched to a virtual time that only moves when it is told to
+class Clock
+{
+  public:
+    static Poco::Timestamp Now() { return s_virtual ? Poco::Timestamp(s_now) : Poco::Timestamp(); }
+    static Poco::Timestamp::TimeDiff Elapsed(const Poco::Timestamp& since) { return Now() - since; }
+
+    static bool IsVirtual() { return s_virtual; }
+    static void SetVirtual(const Poco::Timestamp& now)
+    {
+      s_virtual = true;
+      s_now = now.epochMicroseconds();
+    }
+    static void Advance(Poco::Timestamp::TimeDiff delta) { s_now += delta; }
+
+  private:
+    static bool s_virtual;
+    static Poco::Timestamp::TimeVal s_now;
+};
+
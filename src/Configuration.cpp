@@ -17,12 +17,15 @@
  *
  */
 
-#include <fstream>
+#include <algorithm>
+#include <sstream>
 
 #include <log4cxx/logger.h>
 
 #include <Poco/AutoPtr.h>
 #include <Poco/NumberParser.h>
+#include <Poco/String.h>
+#include <Poco/StringTokenizer.h>
 #include <Poco/DOM/DOMParser.h>
 #include <Poco/DOM/Document.h>
 #include <Poco/DOM/Element.h>
@@ -31,6 +34,8 @@
 #include <Poco/SAX/SAXException.h>
 
 #include "Configuration.h"
+#include "ConfigurationCache.h"
+#include "Networking.h"
 
 using namespace Poco;
 
@@ -63,6 +68,69 @@ bool Configuration::getString(const XML::Element* element, std::string& value)
   return false;
 }
 
+bool Configuration::getBool(const XML::Element* element, bool& value)
+{
+  std::string strValue;
+  if (!getString(element, strValue))
+    return false;
+
+  if (icompare(strValue, "true") == 0 || icompare(strValue, "yes") == 0 || strValue.compare("1") == 0)
+    value = true;
+  else if (icompare(strValue, "false") == 0 || icompare(strValue, "no") == 0 || strValue.compare("0") == 0)
+    value = false;
+  else
+    return false;
+
+  return true;
+}
+
+bool Configuration::parseMacAddress(const std::string& macAddress, uint8_t* mac)
+{
+  StringTokenizer tokenizer(macAddress, ":", StringTokenizer::TOK_TRIM);
+  if (tokenizer.count() != ETH_ALEN)
+    return false;
+
+  size_t index = 0;
+  for (StringTokenizer::Iterator token = tokenizer.begin(); token != tokenizer.end(); ++token, ++index)
+  {
+    unsigned int value;
+    try
+    {
+      value = NumberParser::parseHex(*token);
+    }
+    catch (SyntaxException &e)
+    {
+      return false;
+    }
+
+    if (value > 255)
+      return false;
+
+    mac[index] = static_cast<uint8_t>(value);
+  }
+
+  return true;
+}
+
+std::vector<std::string> Configuration::GetNetworkInterfaces() const
+{
+  std::vector<std::string> interfaces(1, m_networkInterface);
+  for (std::vector<Server>::const_iterator server = m_servers.begin(); server != m_servers.end(); ++server)
+  {
+    const std::string& interface = server->GetMachine().GetInterface();
+    if (!interface.empty() && std::find(interfaces.begin(), interfaces.end(), interface) == interfaces.end())
+      interfaces.push_back(interface);
+  }
+  for (std::vector<Machine>::const_iterator machine = m_machines.begin(); machine != m_machines.end(); ++machine)
+  {
+    const std::string& interface = machine->GetInterface();
+    if (!interface.empty() && std::find(interfaces.begin(), interfaces.end(), interface) == interfaces.end())
+      interfaces.push_back(interface);
+  }
+
+  return interfaces;
+}
+
 bool Configuration::Load(const std::string& file)
 {
   if (file.empty())
@@ -71,9 +139,33 @@ bool Configuration::Load(const std::string& file)
     return false;
   }
 
+  ConfigurationCache cache;
+  if (cache.Open(file))
+  {
+    if (deserialize(cache.GetData(), cache.GetSize()))
+    {
+      LOG4CXX_DEBUG(logger, "Loaded configuration from the cache of " << file);
+      return true;
+    }
+
+    LOG4CXX_WARN(logger, "Ignoring the invalid configuration cache of " << file);
+    *this = Configuration();
+  }
+
   LOG4CXX_DEBUG(logger, "Loading configuration from " << file << "...");
-  std::ifstream fileStream(file.c_str());
-  XML::InputSource fileSource(fileStream);
+  std::istringstream fileStream(cache.GetSource());
+  if (!parse(fileStream))
+    return false;
+
+  std::string data;
+  serialize(data);
+  cache.Store(data);
+  return true;
+}
+
+bool Configuration::parse(std::istream& stream)
+{
+  XML::InputSource fileSource(stream);
 
   XML::DOMParser xmlParser;
   AutoPtr<XML::Document> xmlDoc;
@@ -106,6 +198,38 @@ bool Configuration::Load(const std::string& file)
 
     XML::Element* loggingPatternElement = loggingElement->getChildElement("pattern");
     getString(loggingPatternElement, m_loggingPattern);
+
+    XML::Element* loggingAsyncElement = loggingElement->getChildElement("async");
+    if (loggingAsyncElement != NULL && !getBool(loggingAsyncElement, m_loggingAsync))
+      LOG4CXX_WARN(logger, "Invalid <logging><async> configuration value");
+
+    XML::Element* loggingBufferElement = loggingElement->getChildElement("buffer");
+    std::string strLoggingBuffer;
+    if (getString(loggingBufferElement, strLoggingBuffer))
+    {
+      try
+      {
+        m_loggingBuffer = static_cast<uint32_t>(NumberParser::parseUnsigned(strLoggingBuffer));
+      }
+      catch (SyntaxException &e)
+      {
+        LOG4CXX_WARN(logger, "Invalid <logging><buffer> configuration value");
+      }
+    }
+
+    XML::Element* loggingOverflowElement = loggingElement->getChildElement("overflow");
+    std::string strLoggingOverflow;
+    if (getString(loggingOverflowElement, strLoggingOverflow))
+    {
+      if (icompare(strLoggingOverflow, "drop") == 0)
+        m_loggingOverflow = LogOverflowDrop;
+      else if (icompare(strLoggingOverflow, "block") == 0)
+        m_loggingOverflow = LogOverflowBlock;
+      else if (icompare(strLoggingOverflow, "keepwarnings") == 0)
+        m_loggingOverflow = LogOverflowKeepWarnings;
+      else
+        LOG4CXX_WARN(logger, "Invalid <logging><overflow> configuration value (" << strLoggingOverflow << "), expected drop, block or keepwarnings");
+    }
   }
 
   XML::Element* networkElement = root->getChildElement("network");
@@ -122,6 +246,14 @@ bool Configuration::Load(const std::string& file)
     return false;
   }
 
+  XML::Element* networkPassiveElement = networkElement->getChildElement("passive");
+  if (networkPassiveElement != NULL && !getBool(networkPassiveElement, m_networkPassive))
+    LOG4CXX_WARN(logger, "Invalid <network><passive> configuration value");
+
+  XML::Element* networkNeighboursElement = networkElement->getChildElement("neighbours");
+  if (networkNeighboursElement != NULL && !getBool(networkNeighboursElement, m_networkNeighbours))
+    LOG4CXX_WARN(logger, "Invalid <network><neighbours> configuration value");
+
   XML::Element* pingElement = root->getChildElement("ping");
   if (pingElement != NULL)
   {
@@ -131,7 +263,12 @@ bool Configuration::Load(const std::string& file)
     {
       try
       {
-        m_pingInterval = static_cast<uint16_t>(NumberParser::parseUnsigned(strPingInterval));
+        // the ping timer needs a period, a zero interval would only ping once
+        unsigned int value = NumberParser::parseUnsigned(strPingInterval);
+        if (value == 0)
+          LOG4CXX_WARN(logger, "Invalid <ping><interval> configuration value");
+        else
+          m_pingInterval = static_cast<uint16_t>(value);
       }
       catch (SyntaxException &e)
       {
@@ -152,19 +289,139 @@ bool Configuration::Load(const std::string& file)
         LOG4CXX_WARN(logger, "Invalid <ping><timeout> configuration value");
       }
     }
+
+    XML::Element* pingOfflineIntervalElement = pingElement->getChildElement("offlineinterval");
+    std::string strPingOfflineInterval;
+    if (getString(pingOfflineIntervalElement, strPingOfflineInterval))
+    {
+      try
+      {
+        m_pingOfflineInterval = static_cast<uint16_t>(NumberParser::parseUnsigned(strPingOfflineInterval));
+      }
+      catch (SyntaxException &e)
+      {
+        LOG4CXX_WARN(logger, "Invalid <ping><offlineinterval> configuration value");
+      }
+    }
+
+    XML::Element* pingEarlyExitElement = pingElement->getChildElement("earlyexit");
+    if (pingEarlyExitElement != NULL && !getBool(pingEarlyExitElement, m_pingEarlyExit))
+      LOG4CXX_WARN(logger, "Invalid <ping><earlyexit> configuration value");
   }
 
-  XML::Element* serverElement = root->getChildElement("server");
-  if (serverElement == NULL)
+  XML::Element* sshElement = root->getChildElement("ssh");
+  if (sshElement != NULL)
   {
-    LOG4CXX_ERROR(logger, "Missing <server> tag");
-    return false;
+    XML::Element* sshConnectTimeoutElement = sshElement->getChildElement("connecttimeout");
+    std::string strSshConnectTimeout;
+    if (getString(sshConnectTimeoutElement, strSshConnectTimeout))
+    {
+      try
+      {
+        m_sshConnectTimeout = static_cast<uint16_t>(NumberParser::parseUnsigned(strSshConnectTimeout));
+      }
+      catch (SyntaxException &e)
+      {
+        LOG4CXX_WARN(logger, "Invalid <ssh><connecttimeout> configuration value");
+      }
+    }
+
+    XML::Element* sshExecuteTimeoutElement = sshElement->getChildElement("exectimeout");
+    std::string strSshExecuteTimeout;
+    if (getString(sshExecuteTimeoutElement, strSshExecuteTimeout))
+    {
+      try
+      {
+        m_sshExecuteTimeout = static_cast<uint16_t>(NumberParser::parseUnsigned(strSshExecuteTimeout));
+      }
+      catch (SyntaxException &e)
+      {
+        LOG4CXX_WARN(logger, "Invalid <ssh><exectimeout> configuration value");
+      }
+    }
   }
 
-  if (!parseMachine(serverElement, true, m_server))
+  XML::Element* wakeElement = root->getChildElement("wake");
+  if (wakeElement != NULL)
   {
-    LOG4CXX_ERROR(logger, "Invalid <server> tag");
-    return false;
+    XML::Element* wakeBurstElement = wakeElement->getChildElement("burst");
+    std::string strWakeBurst;
+    if (getString(wakeBurstElement, strWakeBurst))
+    {
+      try
+      {
+        unsigned int value = NumberParser::parseUnsigned(strWakeBurst);
+        if (value == 0 || value > WAKE_MAX_BURST)
+          LOG4CXX_WARN(logger, "Invalid <wake><burst> configuration value");
+        else
+          m_wakeBurst = static_cast<uint8_t>(value);
+      }
+      catch (SyntaxException &e)
+      {
+        LOG4CXX_WARN(logger, "Invalid <wake><burst> configuration value");
+      }
+    }
+
+    XML::Element* wakeUdpElement = wakeElement->getChildElement("udp");
+    if (wakeUdpElement != NULL && !getBool(wakeUdpElement, m_wakeUdp))
+      LOG4CXX_WARN(logger, "Invalid <wake><udp> configuration value");
+  }
+
+  XML::Element* metricsElement = root->getChildElement("metrics");
+  if (metricsElement != NULL)
+  {
+    XML::Element* metricsAddressElement = metricsElement->getChildElement("address");
+    getString(metricsAddressElement, m_metricsAddress);
+
+    XML::Element* metricsPortElement = metricsElement->getChildElement("port");
+    std::string strMetricsPort;
+    if (getString(metricsPortElement, strMetricsPort))
+    {
+      try
+      {
+        m_metricsPort = static_cast<uint16_t>(NumberParser::parseUnsigned(strMetricsPort));
+      }
+      catch (SyntaxException &e)
+      {
+        LOG4CXX_WARN(logger, "Invalid <metrics><port> configuration value");
+      }
+    }
+  }
+
+  XML::Element* discoveryElement = root->getChildElement("discovery");
+  if (discoveryElement != NULL)
+  {
+    XML::Element* discoveryIntervalElement = discoveryElement->getChildElement("interval");
+    std::string strDiscoveryInterval;
+    if (getString(discoveryIntervalElement, strDiscoveryInterval))
+    {
+      try
+      {
+        m_discoveryInterval = NumberParser::parseUnsigned(strDiscoveryInterval);
+      }
+      catch (SyntaxException &e)
+      {
+        LOG4CXX_WARN(logger, "Invalid <discovery><interval> configuration value");
+      }
+    }
+
+    XML::Element* discoveryRateElement = discoveryElement->getChildElement("rate");
+    std::string strDiscoveryRate;
+    if (getString(discoveryRateElement, strDiscoveryRate))
+    {
+      try
+      {
+        unsigned int value = NumberParser::parseUnsigned(strDiscoveryRate);
+        if (value == 0)
+          LOG4CXX_WARN(logger, "Invalid <discovery><rate> configuration value");
+        else
+          m_discoveryRate = value;
+      }
+      catch (SyntaxException &e)
+      {
+        LOG4CXX_WARN(logger, "Invalid <discovery><rate> configuration value");
+      }
+    }
   }
 
   XML::Element* machinesElement = root->getChildElement("machines");
@@ -194,16 +451,269 @@ bool Configuration::Load(const std::string& file)
     machineElement = static_cast<XML::Element*>(machineElement->nextSibling());
   }
 
+  // either a list of servers or a single server needed by all machines
+  XML::Element* serversElement = root->getChildElement("servers");
+  if (serversElement != NULL)
+  {
+    XML::Element* serverElement = serversElement->getChildElement("server");
+    while (serverElement != NULL)
+    {
+      if (serverElement->nodeType() == XML::Node::ELEMENT_NODE)
+      {
+        if (serverElement->nodeName().compare("server") == 0)
+        {
+          Server server;
+          if (!parseServer(serverElement, server))
+          {
+            LOG4CXX_ERROR(logger, "Invalid <server> tag");
+            return false;
+          }
+
+          m_servers.push_back(server);
+        }
+        else if (!serverElement->nodeName().empty())
+          LOG4CXX_WARN(logger, "Unexpected <" << serverElement->nodeName() << "> element, expected <server>");
+      }
+
+      serverElement = static_cast<XML::Element*>(serverElement->nextSibling());
+    }
+  }
+  else
+  {
+    XML::Element* serverElement = root->getChildElement("server");
+    if (serverElement == NULL)
+    {
+      LOG4CXX_ERROR(logger, "Missing <servers> or <server> tag");
+      return false;
+    }
+
+    Server server;
+    if (!parseServer(serverElement, server))
+    {
+      LOG4CXX_ERROR(logger, "Invalid <server> tag");
+      return false;
+    }
+
+    m_servers.push_back(server);
+  }
+
+  if (m_servers.empty())
+  {
+    LOG4CXX_ERROR(logger, "No <server> tag found");
+    return false;
+  }
+
   XML::Element* filesElement = root->getChildElement("files");
   if (filesElement != NULL)
   {
     XML::Element* alwaysOnFile = filesElement->getChildElement("alwayson");
     getString(alwaysOnFile, m_alwaysOnFile);
+
+    XML::Element* stateFile = filesElement->getChildElement("state");
+    getString(stateFile, m_stateFile);
+
+    XML::Element* traceFile = filesElement->getChildElement("trace");
+    getString(traceFile, m_traceFile);
   }
 
   return true;
 }
 
+static void writeMachine(SnapshotWriter& writer, const Machine& machine)
+{
+  writer.WriteString(machine.GetName());
+  writer.WriteString(machine.GetMacAddress());
+  writer.WriteBytes(machine.GetMac(), ETH_ALEN);
+  writer.WriteString(machine.GetIpAddress());
+  writer.WriteString(machine.GetUsername());
+  writer.WriteString(machine.GetPassword());
+  writer.Write(machine.GetTimeout());
+  writer.Write(static_cast<uint8_t>(machine.GetProbe()));
+  writer.Write(machine.GetPort());
+  writer.WriteString(machine.GetInterface());
+  writer.WriteString(machine.GetIpv6Address());
+}
+
+static bool readMachine(SnapshotReader& reader, Machine& machine)
+{
+  std::string name, macAddress, ipAddress, username, password, interface, ipv6Address;
+  uint8_t mac[ETH_ALEN];
+  uint16_t timeout, port;
+  uint8_t probe;
+  if (!reader.ReadString(name) || !reader.ReadString(macAddress) || !reader.ReadBytes(mac, sizeof(mac)) ||
+      !reader.ReadString(ipAddress) || !reader.ReadString(username) || !reader.ReadString(password) ||
+      !reader.Read(timeout) || !reader.Read(probe) || !reader.Read(port) ||
+      !reader.ReadString(interface) || !reader.ReadString(ipv6Address) || probe > ProbeTypeNdp)
+    return false;
+
+  machine = Machine(name, macAddress, mac, ipAddress, username, password, timeout, static_cast<ProbeType>(probe), port, interface, ipv6Address);
+  return true;
+}
+
+void Configuration::serialize(std::string& data) const
+{
+  // the order has to match deserialize() and CONFIGURATION_CACHE_VERSION
+  // has to be increased whenever it changes
+  SnapshotWriter writer(data);
+  writer.WriteString(m_loggingLevel);
+  writer.WriteString(m_loggingPattern);
+  writer.Write(static_cast<uint8_t>(m_loggingAsync));
+  writer.Write(m_loggingBuffer);
+  writer.Write(static_cast<uint8_t>(m_loggingOverflow));
+
+  writer.WriteString(m_networkInterface);
+  writer.Write(static_cast<uint8_t>(m_networkPassive));
+  writer.Write(static_cast<uint8_t>(m_networkNeighbours));
+
+  writer.Write(m_pingTimeout);
+  writer.Write(m_pingInterval);
+  writer.Write(m_pingOfflineInterval);
+  writer.Write(static_cast<uint8_t>(m_pingEarlyExit));
+
+  writer.Write(m_sshConnectTimeout);
+  writer.Write(m_sshExecuteTimeout);
+
+  writer.Write(m_wakeBurst);
+  writer.Write(static_cast<uint8_t>(m_wakeUdp));
+
+  writer.Write(m_discoveryInterval);
+  writer.Write(m_discoveryRate);
+
+  writer.WriteString(m_metricsAddress);
+  writer.Write(m_metricsPort);
+
+  writer.Write(static_cast<uint32_t>(m_machines.size()));
+  for (std::vector<Machine>::const_iterator machine = m_machines.begin(); machine != m_machines.end(); ++machine)
+    writeMachine(writer, *machine);
+
+  writer.Write(static_cast<uint32_t>(m_servers.size()));
+  for (std::vector<Server>::const_iterator server = m_servers.begin(); server != m_servers.end(); ++server)
+  {
+    writeMachine(writer, server->GetMachine());
+    const std::vector<size_t>& clients = server->GetClients();
+    writer.Write(static_cast<uint32_t>(clients.size()));
+    for (std::vector<size_t>::const_iterator client = clients.begin(); client != clients.end(); ++client)
+      writer.Write(static_cast<uint32_t>(*client));
+  }
+
+  writer.WriteString(m_alwaysOnFile);
+  writer.WriteString(m_stateFile);
+  writer.WriteString(m_traceFile);
+}
+
+bool Configuration::deserialize(const uint8_t* data, size_t size)
+{
+  SnapshotReader reader(data, size);
+  uint8_t loggingAsync, loggingOverflow, networkPassive, networkNeighbours, pingEarlyExit, wakeUdp;
+  if (!reader.ReadString(m_loggingLevel) || !reader.ReadString(m_loggingPattern) ||
+      !reader.Read(loggingAsync) || !reader.Read(m_loggingBuffer) || !reader.Read(loggingOverflow) ||
+      !reader.ReadString(m_networkInterface) || !reader.Read(networkPassive) || !reader.Read(networkNeighbours) ||
+      !reader.Read(m_pingTimeout) || !reader.Read(m_pingInterval) || !reader.Read(m_pingOfflineInterval) || !reader.Read(pingEarlyExit) ||
+      !reader.Read(m_sshConnectTimeout) || !reader.Read(m_sshExecuteTimeout) ||
+      !reader.Read(m_wakeBurst) || !reader.Read(wakeUdp) ||
+      !reader.Read(m_discoveryInterval) || !reader.Read(m_discoveryRate) ||
+      !reader.ReadString(m_metricsAddress) || !reader.Read(m_metricsPort) ||
+      loggingOverflow > LogOverflowKeepWarnings)
+    return false;
+
+  m_loggingAsync = loggingAsync != 0;
+  m_loggingOverflow = static_cast<LogOverflow>(loggingOverflow);
+  m_networkPassive = networkPassive != 0;
+  m_networkNeighbours = networkNeighbours != 0;
+  m_pingEarlyExit = pingEarlyExit != 0;
+  m_wakeUdp = wakeUdp != 0;
+
+  uint32_t count;
+  if (!reader.Read(count))
+    return false;
+  m_machines.clear();
+  for (uint32_t index = 0; index < count; ++index)
+  {
+    Machine machine;
+    if (!readMachine(reader, machine))
+      return false;
+    m_machines.push_back(machine);
+  }
+
+  if (!reader.Read(count) || count == 0)
+    return false;
+  m_servers.clear();
+  for (uint32_t index = 0; index < count; ++index)
+  {
+    Machine machine;
+    uint32_t clientCount;
+    if (!readMachine(reader, machine) || !reader.Read(clientCount))
+      return false;
+
+    std::vector<size_t> clients;
+    for (uint32_t client = 0; client < clientCount; ++client)
+    {
+      uint32_t clientIndex;
+      if (!reader.Read(clientIndex) || clientIndex >= m_machines.size())
+        return false;
+      clients.push_back(clientIndex);
+    }
+    m_servers.push_back(Server(machine, clients));
+  }
+
+  return reader.ReadString(m_alwaysOnFile) && reader.ReadString(m_stateFile) && reader.ReadString(m_traceFile) &&
+         reader.IsAtEnd();
+}
+
+bool Configuration::parseServer(const Poco::XML::Element* serverElement, Server& server) const
+{
+  Machine machine;
+  if (!parseMachine(serverElement, true, machine))
+    return false;
+
+  // without any <clients> the server is needed by all machines
+  std::vector<size_t> clients;
+  XML::Element* clientsElement = serverElement->getChildElement("clients");
+  if (clientsElement == NULL)
+  {
+    for (size_t index = 0; index < m_machines.size(); ++index)
+      clients.push_back(index);
+  }
+  else
+  {
+    XML::Element* clientElement = clientsElement->getChildElement("client");
+    while (clientElement != NULL)
+    {
+      if (clientElement->nodeType() == XML::Node::ELEMENT_NODE)
+      {
+        if (clientElement->nodeName().compare("client") == 0)
+        {
+          std::string name;
+          if (!getString(clientElement, name) || name.empty())
+          {
+            LOG4CXX_ERROR(logger, "Invalid <server><clients><client> tag");
+            return false;
+          }
+
+          size_t index = 0;
+          while (index < m_machines.size() && m_machines[index].GetName() != name)
+            ++index;
+          if (index >= m_machines.size())
+          {
+            LOG4CXX_ERROR(logger, "Unknown <client> " << name << " of <server> " << machine.GetName());
+            return false;
+          }
+
+          if (std::find(clients.begin(), clients.end(), index) == clients.end())
+            clients.push_back(index);
+        }
+        else if (!clientElement->nodeName().empty())
+          LOG4CXX_WARN(logger, "Unexpected <" << clientElement->nodeName() << "> element, expected <client>");
+      }
+
+      clientElement = static_cast<XML::Element*>(clientElement->nextSibling());
+    }
+  }
+
+  server = Server(machine, clients);
+  return true;
+}
+
 bool Configuration::parseMachine(const Poco::XML::Element* machineElement, bool needsCredentials, Machine& machine)
 {
   XML::Element* nameElement = machineElement->getChildElement("name");
@@ -221,6 +731,13 @@ bool Configuration::parseMachine(const Poco::XML::Element* machineElement, bool
     return false;
   }
 
+  uint8_t mac[ETH_ALEN];
+  if (!parseMacAddress(macAddress, mac))
+  {
+    LOG4CXX_ERROR(logger, "Invalid <machine><mac> tag (" << macAddress << ")");
+    return false;
+  }
+
   std::string username, password;
   if (needsCredentials)
   {
@@ -235,9 +752,63 @@ bool Configuration::parseMachine(const Poco::XML::Element* machineElement, bool
     }
   }
 
+  ProbeType probe = ProbeTypeIcmp;
+  XML::Element* probeElement = machineElement->getChildElement("probe");
+  std::string strProbe;
+  if (getString(probeElement, strProbe))
+  {
+    if (icompare(strProbe, "arp") == 0)
+      probe = ProbeTypeArp;
+    else if (icompare(strProbe, "tcp") == 0)
+      probe = ProbeTypeTcp;
+    else if (icompare(strProbe, "icmp6") == 0)
+      probe = ProbeTypeIcmp6;
+    else if (icompare(strProbe, "ndp") == 0)
+      probe = ProbeTypeNdp;
+    else if (icompare(strProbe, "icmp") != 0)
+    {
+      LOG4CXX_ERROR(logger, "Invalid <machine><probe> tag (" << strProbe << "), expected icmp, arp, tcp, icmp6 or ndp");
+      return false;
+    }
+  }
+
+  // machines on another segment (e.g. a VLAN) are probed through their own
+  // interface instead of the default one
+  XML::Element* interfaceElement = machineElement->getChildElement("interface");
+  std::string interface;
+  if (interfaceElement != NULL && (!getString(interfaceElement, interface) || interface.empty()))
+  {
+    LOG4CXX_ERROR(logger, "Invalid <machine><interface> tag");
+    return false;
+  }
+
+  XML::Element* ipv6AddressElement = machineElement->getChildElement("ipv6");
+  std::string ipv6Address;
+  if (ipv6AddressElement != NULL && (!getString(ipv6AddressElement, ipv6Address) || ipv6Address.empty()))
+  {
+    LOG4CXX_ERROR(logger, "Invalid <machine><ipv6> tag");
+    return false;
+  }
+
+  uint16_t port = 0;
+  if (probe == ProbeTypeTcp)
+  {
+    XML::Element* portElement = machineElement->getChildElement("port");
+    std::string strPort;
+    unsigned int value = 0;
+    if (!getString(portElement, strPort) || !NumberParser::tryParseUnsigned(strPort, value) ||
+        value == 0 || value > 65535)
+    {
+      LOG4CXX_ERROR(logger, "Missing or invalid <machine><port> tag for <probe>tcp</probe>");
+      return false;
+    }
+
+    port = static_cast<uint16_t>(value);
+  }
+
   try
   {
-     machine =  Machine(name, macAddress, ipAddress, username, password, static_cast<uint16_t>(NumberParser::parseUnsigned(strTimeout)));
+     machine =  Machine(name, macAddress, mac, ipAddress, username, password, static_cast<uint16_t>(NumberParser::parseUnsigned(strTimeout)), probe, port, interface, ipv6Address);
      return true;
   }
   catch (SyntaxException &e)
@@ -18,12 +18,16 @@
  *
  */
 
+#include <algorithm>
+#include <iosfwd>
 #include <string>
 #include <vector>
 
 #include <stdint.h>
 
+#include "AsyncFileAppender.h"
 #include "Machine.h"
+#include "Server.h"
 
 namespace Poco
 {
@@ -39,41 +43,120 @@ class Configuration
     Configuration()
      : m_loggingLevel("INFO"),
        m_loggingPattern("\%d{dd.MM.yyyy HH:mm:ss.SSS} \%-5p [\%c] \%m\%n"),
+       m_loggingAsync(false),
+       m_loggingBuffer(65536),
+       m_loggingOverflow(LogOverflowDrop),
        m_networkInterface(),
+       m_networkPassive(false),
+       m_networkNeighbours(false),
        m_pingTimeout(10),
-       m_pingInterval(30)
+       m_pingInterval(30),
+       m_pingOfflineInterval(0),
+       m_pingEarlyExit(false),
+       m_sshConnectTimeout(10),
+       m_sshExecuteTimeout(10),
+       m_wakeBurst(1),
+       m_wakeUdp(false),
+       m_discoveryInterval(0),
+       m_discoveryRate(1000),
+       m_metricsAddress("0.0.0.0"),
+       m_metricsPort(0)
     { }
 
+    // the XML document is only parsed if it has changed since the last time
+    // it has been loaded, otherwise its cached snapshot is used
     bool Load(const std::string& file);
 
     const std::string& GetLoggingLevel() const { return m_loggingLevel; }
     const std::string& GetLoggingPattern() const { return m_loggingPattern; }
+    // the log file is written by a background thread
+    bool IsLoggingAsync() const { return m_loggingAsync; }
+    uint32_t GetLoggingBuffer() const { return m_loggingBuffer; }
+    LogOverflow GetLoggingOverflow() const { return m_loggingOverflow; }
 
     const std::string& GetNetworkInterface() const { return m_networkInterface; }
+    // the default interface followed by every other one a machine is bound to
+    std::vector<std::string> GetNetworkInterfaces() const;
+    bool IsNetworkPassive() const { return m_networkPassive; }
+    bool IsNetworkNeighbours() const { return m_networkNeighbours; }
 
     uint8_t GetPingTimeout() const { return m_pingTimeout; }
     uint16_t GetPingInterval() const { return m_pingInterval; }
-
-    Machine& GetServer() { return m_server; }
+    // machines which are offline are pinged at the regular interval unless
+    // a slower one has been configured
+    uint16_t GetPingOfflineInterval() const { return std::max(m_pingOfflineInterval, m_pingInterval); }
+    // a probe round ends as soon as the replies can't change any decision
+    bool IsPingEarlyExit() const { return m_pingEarlyExit; }
+
+    uint16_t GetSshConnectTimeout() const { return m_sshConnectTimeout; }
+    uint16_t GetSshExecuteTimeout() const { return m_sshExecuteTimeout; }
+
+    uint8_t GetWakeBurst() const { return m_wakeBurst; }
+    bool IsWakeUdp() const { return m_wakeUdp; }
+
+    // the subnets are only swept for machines with a new IP address if an
+    // interval (in seconds) has been configured, the rate is the maximum
+    // number of ARP requests per second
+    uint32_t GetDiscoveryInterval() const { return m_discoveryInterval; }
+    uint32_t GetDiscoveryRate() const { return m_discoveryRate; }
+
+    // the metrics are only served if a port has been configured
+    const std::string& GetMetricsAddress() const { return m_metricsAddress; }
+    uint16_t GetMetricsPort() const { return m_metricsPort; }
+
+    std::vector<Server>& GetServers() { return m_servers; }
+    const std::vector<Server>& GetServers() const { return m_servers; }
     std::vector<Machine>& GetMachines() { return m_machines; }
+    const std::vector<Machine>& GetMachines() const { return m_machines; }
 
     const std::string& GetAlwaysOnFile() const { return m_alwaysOnFile; }
+    const std::string& GetStateFile() const { return m_stateFile; }
+    const std::string& GetTraceFile() const { return m_traceFile; }
 
   private:
+    bool parse(std::istream& stream);
+    // binary snapshot of all settings for the ConfigurationCache
+    void serialize(std::string& data) const;
+    bool deserialize(const uint8_t* data, size_t size);
+
     static bool getString(const Poco::XML::Element* element, std::string& valuu);
+    static bool getBool(const Poco::XML::Element* element, bool& value);
+    static bool parseMacAddress(const std::string& macAddress, uint8_t* mac);
+    bool parseServer(const Poco::XML::Element* serverElement, Server& server) const;
     static bool parseMachine(const Poco::XML::Element* machineElement, bool needsCredentials, Machine& machine);
 
     std::string m_loggingLevel;
     std::string m_loggingPattern;
+    bool m_loggingAsync;
+    uint32_t m_loggingBuffer;
+    LogOverflow m_loggingOverflow;
 
     std::string m_networkInterface;
+    bool m_networkPassive;
+    bool m_networkNeighbours;
 
     uint8_t m_pingTimeout;
     uint16_t m_pingInterval;
+    uint16_t m_pingOfflineInterval;
+    bool m_pingEarlyExit;
+
+    uint16_t m_sshConnectTimeout;
+    uint16_t m_sshExecuteTimeout;
+
+    uint8_t m_wakeBurst;
+    bool m_wakeUdp;
+
+    uint32_t m_discoveryInterval;
+    uint32_t m_discoveryRate;
+
+    std::string m_metricsAddress;
+    uint16_t m_metricsPort;
 
-    Machine m_server;
+    std::vector<Server> m_servers;
     std::vector<Machine> m_machines;
 
     std::string m_alwaysOnFile;
+    std::string m_stateFile;
+    std::string m_traceFile;
 };
 
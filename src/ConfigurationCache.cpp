@@ -0,0 +1,200 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <log4cxx/logger.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ConfigurationCache.h"
+
+#define CONFIGURATION_CACHE_MAGIC   "HMCONF"
+// has to be increased whenever the layout of the snapshot changes
+#define CONFIGURATION_CACHE_VERSION 1
+
+#define FNV_OFFSET_BASIS        UINT64_C(14695981039346656037)
+#define FNV_PRIME               UINT64_C(1099511628211)
+
+#define SECONDS_TO_NANOSECONDS  INT64_C(1000000000)
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("ConfigurationCache"));
+
+ConfigurationCache::ConfigurationCache()
+  : m_file(),
+    m_source(),
+    m_modified(0),
+    m_hash(0),
+    m_map(NULL),
+    m_mapSize(0)
+{ }
+
+ConfigurationCache::~ConfigurationCache()
+{
+  Close();
+}
+
+bool ConfigurationCache::Open(const std::string& file)
+{
+  Close();
+  m_file = file;
+  m_source.clear();
+
+  int descriptor = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (descriptor < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to open " << file << ": " << strerror(errno));
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(descriptor, &info) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to determine the size of " << file << ": " << strerror(errno));
+    close(descriptor);
+    return false;
+  }
+
+  m_modified = static_cast<int64_t>(info.st_mtim.tv_sec) * SECONDS_TO_NANOSECONDS + info.st_mtim.tv_nsec;
+  m_source.resize(static_cast<size_t>(info.st_size));
+  size_t position = 0;
+  while (position < m_source.size())
+  {
+    ssize_t length = read(descriptor, &m_source[position], m_source.size() - position);
+    if (length < 0 && errno == EINTR)
+      continue;
+    if (length <= 0)
+      break;
+    position += static_cast<size_t>(length);
+  }
+  close(descriptor);
+  m_source.resize(position);
+  m_hash = hash(m_source.data(), m_source.size());
+
+  // the whole cache is mapped at once and only used if it matches the file
+  const std::string path = GetPath(file);
+  descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (descriptor < 0)
+    return false;
+
+  if (fstat(descriptor, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(ConfigurationCacheHeader))
+  {
+    close(descriptor);
+    return false;
+  }
+
+  void* data = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+  close(descriptor);
+  if (data == MAP_FAILED)
+  {
+    LOG4CXX_WARN(logger, "Failed to map " << path << ": " << strerror(errno));
+    return false;
+  }
+
+  m_map = static_cast<const uint8_t*>(data);
+  m_mapSize = static_cast<size_t>(info.st_size);
+
+  const ConfigurationCacheHeader* header = reinterpret_cast<const ConfigurationCacheHeader*>(m_map);
+  if (memcmp(header->magic, CONFIGURATION_CACHE_MAGIC, sizeof(CONFIGURATION_CACHE_MAGIC)) != 0 ||
+      header->version != CONFIGURATION_CACHE_VERSION ||
+      header->modified != m_modified || header->size != m_source.size() || header->hash != m_hash ||
+      header->dataSize != GetSize() || header->dataHash != hash(GetData(), GetSize()))
+  {
+    LOG4CXX_DEBUG(logger, "The configuration cache " << path << " is outdated");
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void ConfigurationCache::Close()
+{
+  if (m_map != NULL)
+    munmap(const_cast<uint8_t*>(m_map), m_mapSize);
+  m_map = NULL;
+  m_mapSize = 0;
+}
+
+bool ConfigurationCache::Store(const std::string& data)
+{
+  if (m_file.empty())
+    return false;
+
+  ConfigurationCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CONFIGURATION_CACHE_MAGIC, sizeof(CONFIGURATION_CACHE_MAGIC));
+  header.version = CONFIGURATION_CACHE_VERSION;
+  header.modified = m_modified;
+  header.size = m_source.size();
+  header.hash = m_hash;
+  header.dataSize = data.size();
+  header.dataHash = hash(data.data(), data.size());
+
+  // the configuration may contain passwords and the cache is replaced
+  // atomically so that a concurrent Open() never sees it half written
+  const std::string path = GetPath(m_file);
+  const std::string temporaryPath = path + ".tmp";
+  int descriptor = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if (descriptor < 0)
+  {
+    LOG4CXX_DEBUG(logger, "Failed to create " << temporaryPath << ": " << strerror(errno));
+    return false;
+  }
+
+  std::string content(reinterpret_cast<const char*>(&header), sizeof(header));
+  content.append(data);
+  size_t position = 0;
+  while (position < content.size())
+  {
+    ssize_t length = write(descriptor, content.data() + position, content.size() - position);
+    if (length < 0 && errno == EINTR)
+      continue;
+    if (length <= 0)
+      break;
+    position += static_cast<size_t>(length);
+  }
+
+  if (close(descriptor) < 0 || position < content.size() || rename(temporaryPath.c_str(), path.c_str()) < 0)
+  {
+    LOG4CXX_WARN(logger, "Failed to write the configuration cache " << path << ": " << strerror(errno));
+    unlink(temporaryPath.c_str());
+    return false;
+  }
+
+  LOG4CXX_DEBUG(logger, "Wrote the configuration cache " << path);
+  return true;
+}
+
+uint64_t ConfigurationCache::hash(const void* data, size_t size)
+{
+  // FNV-1a is good enough to notice changes and doesn't need a library
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint64_t value = FNV_OFFSET_BASIS;
+  for (size_t index = 0; index < size; ++index)
+  {
+    value ^= bytes[index];
+    value *= FNV_PRIME;
+  }
+
+  return value;
+}
@@ -0,0 +1,155 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+
+#include <stdint.h>
+#include <string.h>
+
+#define CONFIGURATION_CACHE_SUFFIX  ".cache"
+
+// fixed layout of the header of the configuration cache, all values are
+// stored in host byte order
+typedef struct ConfigurationCacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  // modification time (in nanoseconds since the epoch), size and hash of the
+  // configuration file the snapshot has been created from
+  int64_t modified;
+  uint64_t size;
+  uint64_t hash;
+  // size and hash of the snapshot following the header
+  uint64_t dataSize;
+  uint64_t dataHash;
+} ConfigurationCacheHeader;
+
+// appends values in host byte order to a snapshot
+class SnapshotWriter
+{
+  public:
+    explicit SnapshotWriter(std::string& data)
+      : m_data(data)
+    { }
+
+    template<typename T> void Write(T value) { m_data.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void WriteBytes(const uint8_t* data, size_t size) { m_data.append(reinterpret_cast<const char*>(data), size); }
+    void WriteString(const std::string& value)
+    {
+      Write(static_cast<uint32_t>(value.size()));
+      m_data.append(value);
+    }
+
+  private:
+    SnapshotWriter(const SnapshotWriter&);
+    SnapshotWriter& operator=(const SnapshotWriter&);
+
+    std::string& m_data;
+};
+
+// reads the values written by a SnapshotWriter, every read fails once the
+// end of the snapshot has been reached
+class SnapshotReader
+{
+  public:
+    SnapshotReader(const uint8_t* data, size_t size)
+      : m_data(data),
+        m_size(size),
+        m_position(0)
+    { }
+
+    bool IsAtEnd() const { return m_position == m_size; }
+
+    template<typename T> bool Read(T& value)
+    {
+      if (m_size - m_position < sizeof(value))
+        return false;
+
+      memcpy(&value, m_data + m_position, sizeof(value));
+      m_position += sizeof(value);
+      return true;
+    }
+    bool ReadBytes(uint8_t* data, size_t size)
+    {
+      if (m_size - m_position < size)
+        return false;
+
+      memcpy(data, m_data + m_position, size);
+      m_position += size;
+      return true;
+    }
+    bool ReadString(std::string& value)
+    {
+      uint32_t length;
+      if (!Read(length) || m_size - m_position < length)
+        return false;
+
+      value.assign(reinterpret_cast<const char*>(m_data + m_position), length);
+      m_position += length;
+      return true;
+    }
+
+  private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_position;
+};
+
+// binary snapshot of a parsed configuration stored next to its XML file so
+// that the XML document only has to be parsed after it has changed, the
+// snapshot is only used for the exact content and modification time of the
+// file it has been created from
+class ConfigurationCache
+{
+  public:
+    ConfigurationCache();
+    ~ConfigurationCache();
+
+    static std::string GetPath(const std::string& file) { return file + CONFIGURATION_CACHE_SUFFIX; }
+
+    // reads the configuration file and maps its cache, returns false if
+    // there is no valid cache for the current content of the file
+    bool Open(const std::string& file);
+    void Close();
+
+    // the content of the configuration file read by Open()
+    const std::string& GetSource() const { return m_source; }
+    // the snapshot mapped by a successful Open()
+    const uint8_t* GetData() const { return m_map != NULL ? m_map + sizeof(ConfigurationCacheHeader) : NULL; }
+    size_t GetSize() const { return m_map != NULL ? m_mapSize - sizeof(ConfigurationCacheHeader) : 0; }
+
+    // replaces the cache of the file read by Open() with the given snapshot
+    bool Store(const std::string& data);
+
+  private:
+    ConfigurationCache(const ConfigurationCache&);
+    ConfigurationCache& operator=(const ConfigurationCache&);
+
+    static uint64_t hash(const void* data, size_t size);
+
+    std::string m_file;
+    std::string m_source;
+    int64_t m_modified;
+    uint64_t m_hash;
+
+    const uint8_t* m_map;
+    size_t m_mapSize;
+};
@@ -0,0 +1,184 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <vector>
+
+#include <log4cxx/logger.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ControlSocket.h"
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("ControlSocket"));
+
+static bool toAddress(const std::string& path, struct sockaddr_un& address)
+{
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    return false;
+
+  memcpy(address.sun_path, path.c_str(), path.size());
+  return true;
+}
+
+// receives a whole datagram no matter how large it is
+static bool receiveDatagram(int socket, std::string& data, struct sockaddr_un* sender, socklen_t* senderLength)
+{
+  ssize_t length = recv(socket, NULL, 0, MSG_PEEK | MSG_TRUNC);
+  if (length < 0)
+    return false;
+
+  std::vector<char> buffer(static_cast<size_t>(length) + 1);
+  length = recvfrom(socket, &buffer[0], buffer.size(), 0, reinterpret_cast<struct sockaddr*>(sender), senderLength);
+  if (length < 0)
+    return false;
+
+  data.assign(&buffer[0], static_cast<size_t>(length));
+  return true;
+}
+
+ControlSocket::ControlSocket()
+  : m_path(),
+    m_socket(-1),
+    m_senderLength(0)
+{
+  memset(&m_sender, 0, sizeof(m_sender));
+}
+
+ControlSocket::~ControlSocket()
+{
+  if (m_socket >= 0)
+  {
+    close(m_socket);
+    unlink(m_path.c_str());
+  }
+}
+
+bool ControlSocket::Open(const std::string& path)
+{
+  struct sockaddr_un address;
+  if (!toAddress(path, address))
+  {
+    LOG4CXX_ERROR(logger, "Control socket path " << path << " is too long");
+    return false;
+  }
+
+  m_socket = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (m_socket < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to open the control socket: " << strerror(errno));
+    return false;
+  }
+
+  // a previous instance may have left its socket behind
+  unlink(path.c_str());
+  if (bind(m_socket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to bind the control socket to " << path << ": " << strerror(errno));
+    close(m_socket);
+    m_socket = -1;
+    return false;
+  }
+
+  m_path = path;
+  chmod(path.c_str(), 0660);
+  return true;
+}
+
+bool ControlSocket::Receive(std::string& command)
+{
+  if (m_socket < 0)
+    return false;
+
+  m_senderLength = sizeof(m_sender);
+  if (!receiveDatagram(m_socket, command, &m_sender, &m_senderLength))
+  {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      LOG4CXX_WARN(logger, "Failed to receive a command: " << strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+void ControlSocket::Reply(const std::string& response)
+{
+  // a client which didn't bind an address can't be answered
+  if (m_socket < 0 || m_senderLength <= sizeof(sa_family_t))
+    return;
+
+  if (sendto(m_socket, response.data(), response.size(), MSG_DONTWAIT,
+             reinterpret_cast<struct sockaddr*>(&m_sender), m_senderLength) < 0)
+    LOG4CXX_WARN(logger, "Failed to send a response: " << strerror(errno));
+}
+
+ControlResult ControlSocket::Send(const std::string& path, const std::string& command, std::string& response, int timeout)
+{
+  struct sockaddr_un address;
+  if (!toAddress(path, address))
+  {
+    errno = ENAMETOOLONG;
+    return ControlResultFailed;
+  }
+
+  int client = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (client < 0)
+    return ControlResultFailed;
+
+  // let the kernel pick an abstract address so that the daemon can answer
+  struct sockaddr_un local;
+  memset(&local, 0, sizeof(local));
+  local.sun_family = AF_UNIX;
+
+  ControlResult result = ControlResultFailed;
+  if (bind(client, reinterpret_cast<struct sockaddr*>(&local), sizeof(sa_family_t)) == 0)
+  {
+    // only a missing or stale socket means that the daemon isn't running
+    if (connect(client, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0)
+    {
+      if (errno == ENOENT || errno == ECONNREFUSED)
+        result = ControlResultNotRunning;
+      else if (errno == EACCES || errno == EPERM)
+        result = ControlResultDenied;
+    }
+    else if (send(client, command.data(), command.size(), 0) == static_cast<ssize_t>(command.size()))
+    {
+      struct pollfd descriptor;
+      descriptor.fd = client;
+      descriptor.events = POLLIN;
+      descriptor.revents = 0;
+      int ready = poll(&descriptor, 1, timeout);
+      if (ready == 0)
+        result = ControlResultTimeout;
+      else if (ready == 1 && receiveDatagram(client, response, NULL, NULL))
+        result = ControlResultAnswered;
+    }
+  }
+
+  // the caller may report why sending failed
+  int error = errno;
+  close(client);
+  errno = error;
+  return result;
+}
@@ -0,0 +1,70 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// outcome of sending a command to the daemon
+typedef enum ControlResult
+{
+  ControlResultAnswered = 0,
+  // nobody is listening on the socket
+  ControlResultNotRunning,
+  // the socket may not be written by the calling user
+  ControlResultDenied,
+  // the daemon is running but didn't answer in time
+  ControlResultTimeout,
+  // anything else went wrong, errno tells what
+  ControlResultFailed
+} ControlResult;
+
+// datagram based Unix domain socket through which the running daemon can be
+// queried and controlled, every datagram holds a single command or response
+class ControlSocket
+{
+  public:
+    ControlSocket();
+    ~ControlSocket();
+
+    bool Open(const std::string& path);
+    int GetDescriptor() const { return m_socket; }
+
+    // receives the next pending command, returns false if there is none
+    bool Receive(std::string& command);
+    // answers the sender of the last received command
+    void Reply(const std::string& response);
+
+    // sends a command to the daemon listening on the given path and waits
+    // for its response
+    static ControlResult Send(const std::string& path, const std::string& command, std::string& response, int timeout);
+
+  private:
+    ControlSocket(const ControlSocket&);
+    ControlSocket& operator=(const ControlSocket&);
+
+    std::string m_path;
+    int m_socket;
+
+    struct sockaddr_un m_sender;
+    socklen_t m_senderLength;
+};
+
@@ -0,0 +1,335 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <crafter.h>
+
+#include <log4cxx/logger.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/ether.h>
+#include <netinet/if_ether.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Discovery.h"
+
+// requests are sent in small batches spread out evenly over the sweep
+#define DISCOVERY_BATCH         16
+// how long the replies to the last batch are waited for (in milliseconds)
+#define DISCOVERY_LINGER        250
+// larger subnets than a /20 would take too long to sweep
+#define DISCOVERY_MAX_SIZE      4096
+
+// the sockets of the subnets are tagged with their index
+#define DISCOVERY_TAG_TIMER     UINT64_MAX
+
+#define SECONDS_TO_MICROSECONDS 1000000
+#define MILLISECONDS_TO_MICROSECONDS 1000
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("Discovery"));
+
+Discovery::Discovery()
+  : m_subnets(),
+    m_epoll(-1),
+    m_timer(),
+    m_sweeping(false),
+    m_pause(0),
+    m_subnet(0),
+    m_offset(0),
+    m_sent(0),
+    m_found(0),
+    m_start()
+{
+  m_epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epoll < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to create an epoll instance: " << strerror(errno));
+    return;
+  }
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u64 = DISCOVERY_TAG_TIMER;
+  if (m_timer.GetDescriptor() < 0 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_timer.GetDescriptor(), &event) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to watch the discovery timer: " << strerror(errno));
+    close(m_epoll);
+    m_epoll = -1;
+  }
+}
+
+Discovery::~Discovery()
+{
+  for (std::vector<Subnet>::const_iterator subnet = m_subnets.begin(); subnet != m_subnets.end(); ++subnet)
+    close(subnet->descriptor);
+
+  if (m_epoll >= 0)
+    close(m_epoll);
+}
+
+bool Discovery::Add(const std::string& interface)
+{
+  Subnet subnet;
+  subnet.interface = interface;
+  subnet.interfaceIndex = static_cast<int>(if_nametoindex(interface.c_str()));
+  if (subnet.interfaceIndex == 0)
+  {
+    LOG4CXX_ERROR(logger, "Unknown interface " << interface);
+    return false;
+  }
+
+  const std::string ip = Crafter::GetMyIP(interface);
+  const std::string mac = Crafter::GetMyMAC(interface);
+  struct ether_addr localMac;
+  if (inet_pton(AF_INET, ip.c_str(), &subnet.localIp) != 1 || ether_aton_r(mac.c_str(), &localMac) == NULL)
+  {
+    LOG4CXX_ERROR(logger, "Failed to determine the addresses of " << interface);
+    return false;
+  }
+  memcpy(subnet.localMac, localMac.ether_addr_octet, ETH_ALEN);
+
+  int inetSocket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (inetSocket < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to open a socket to query the netmask: " << strerror(errno));
+    return false;
+  }
+
+  struct ifreq request;
+  memset(&request, 0, sizeof(request));
+  strncpy(request.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+  int rc = ioctl(inetSocket, SIOCGIFNETMASK, &request);
+  close(inetSocket);
+  if (rc < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to determine the netmask of " << interface << ": " << strerror(errno));
+    return false;
+  }
+
+  const uint32_t netmask = ntohl(reinterpret_cast<struct sockaddr_in*>(&request.ifr_netmask)->sin_addr.s_addr);
+  subnet.network = ntohl(subnet.localIp) & netmask;
+  subnet.size = ~netmask + 1;
+  if (netmask == 0 || subnet.size > DISCOVERY_MAX_SIZE || subnet.size < 4)
+  {
+    LOG4CXX_ERROR(logger, "The subnet of " << interface << " (/" << __builtin_popcount(netmask) << ") is too large or too small to sweep");
+    return false;
+  }
+
+  subnet.descriptor = socket(AF_PACKET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, htons(ETH_P_ARP));
+  if (subnet.descriptor < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to open an ARP socket: " << strerror(errno));
+    return false;
+  }
+
+  struct sockaddr_ll address;
+  memset(&address, 0, sizeof(address));
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = htons(ETH_P_ARP);
+  address.sll_ifindex = subnet.interfaceIndex;
+  if (bind(subnet.descriptor, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to bind the ARP socket to " << interface << ": " << strerror(errno));
+    close(subnet.descriptor);
+    return false;
+  }
+
+  m_subnets.push_back(subnet);
+  return true;
+}
+
+bool Discovery::Start(unsigned int rate)
+{
+  if (m_sweeping || m_subnets.empty() || m_epoll < 0)
+    return false;
+
+  if (rate == 0)
+    rate = 1;
+  m_pause = static_cast<Poco::Timestamp::TimeDiff>(DISCOVERY_BATCH) * SECONDS_TO_MICROSECONDS / rate;
+
+  // the sockets see every ARP frame on the interfaces so they are only
+  // watched while sweeping and whatever has been queued since the last sweep
+  // is outdated
+  for (size_t index = 0; index < m_subnets.size(); ++index)
+  {
+    Subnet& subnet = m_subnets[index];
+    subnet.replied.clear();
+    receive(subnet, NULL);
+    subnet.replied.assign(subnet.size, 0);
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = index;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, subnet.descriptor, &event) < 0)
+      LOG4CXX_WARN(logger, "Failed to watch the ARP socket of " << subnet.interface << ": " << strerror(errno));
+  }
+
+  m_sweeping = true;
+  m_subnet = 0;
+  m_offset = 1;
+  m_sent = 0;
+  m_found = 0;
+  m_start.update();
+  sendBatch();
+  return true;
+}
+
+void Discovery::Process(std::vector<Sighting>& sightings)
+{
+  struct epoll_event events[16];
+  int count = epoll_wait(m_epoll, events, sizeof(events) / sizeof(events[0]), 0);
+  if (count < 0)
+  {
+    if (errno != EINTR)
+      LOG4CXX_WARN(logger, "Failed to check the discovery sockets: " << strerror(errno));
+    return;
+  }
+
+  bool expired = false;
+  for (int event = 0; event < count; ++event)
+  {
+    if (events[event].data.u64 == DISCOVERY_TAG_TIMER)
+      expired = m_timer.Acknowledge() > 0;
+    else if (events[event].data.u64 < m_subnets.size())
+      receive(m_subnets[static_cast<size_t>(events[event].data.u64)], &sightings);
+  }
+
+  if (!expired || !m_sweeping)
+    return;
+
+  // once everything has been sent the timer waits for the last replies
+  if (m_subnet < m_subnets.size())
+    sendBatch();
+  else
+  {
+    for (std::vector<Subnet>::iterator subnet = m_subnets.begin(); subnet != m_subnets.end(); ++subnet)
+      receive(*subnet, &sightings);
+    finish();
+  }
+}
+
+void Discovery::sendBatch()
+{
+  for (unsigned int batch = 0; batch < DISCOVERY_BATCH && m_subnet < m_subnets.size(); ++batch)
+  {
+    const Subnet& subnet = m_subnets[m_subnet];
+    const in_addr_t destination = htonl(subnet.network + m_offset);
+    if (destination != subnet.localIp && send(subnet, destination))
+      ++m_sent;
+
+    // neither the network nor the broadcast address are swept
+    if (++m_offset + 1 >= subnet.size)
+    {
+      ++m_subnet;
+      m_offset = 1;
+    }
+  }
+
+  if (!m_timer.Start(m_subnet < m_subnets.size() ? m_pause : DISCOVERY_LINGER * MILLISECONDS_TO_MICROSECONDS))
+  {
+    LOG4CXX_ERROR(logger, "Failed to pace the discovery, aborting the sweep");
+    finish();
+  }
+}
+
+void Discovery::finish()
+{
+  m_timer.Stop();
+  m_timer.Acknowledge();
+  for (std::vector<Subnet>::iterator subnet = m_subnets.begin(); subnet != m_subnets.end(); ++subnet)
+  {
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, subnet->descriptor, NULL);
+    subnet->replied.clear();
+  }
+
+  m_sweeping = false;
+  LOG4CXX_DEBUG(logger, "Swept " << m_sent << " addresses on " << m_subnets.size() << " subnets in " << m_start.elapsed() / MILLISECONDS_TO_MICROSECONDS
+                        << "ms, " << m_found << " machines replied");
+}
+
+bool Discovery::send(const Subnet& subnet, in_addr_t destination)
+{
+  struct ether_arp request;
+  memset(&request, 0, sizeof(request));
+  request.arp_hrd = htons(ARPHRD_ETHER);
+  request.arp_pro = htons(ETHERTYPE_IP);
+  request.arp_hln = ETH_ALEN;
+  request.arp_pln = sizeof(in_addr_t);
+  request.arp_op = htons(ARPOP_REQUEST);
+  memcpy(request.arp_sha, subnet.localMac, ETH_ALEN);
+  memcpy(request.arp_spa, &subnet.localIp, sizeof(in_addr_t));
+  memcpy(request.arp_tpa, &destination, sizeof(in_addr_t));
+
+  struct sockaddr_ll address;
+  memset(&address, 0, sizeof(address));
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = htons(ETH_P_ARP);
+  address.sll_ifindex = subnet.interfaceIndex;
+  address.sll_halen = ETH_ALEN;
+  memset(address.sll_addr, 0xFF, ETH_ALEN);
+  if (sendto(subnet.descriptor, &request, sizeof(request), 0, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0)
+  {
+    LOG4CXX_DEBUG(logger, "Failed to send an ARP request on " << subnet.interface << ": " << strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+void Discovery::receive(Subnet& subnet, std::vector<Sighting>* sightings)
+{
+  struct ether_arp reply;
+  while (true)
+  {
+    ssize_t length = recv(subnet.descriptor, &reply, sizeof(reply), 0);
+    if (length < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        LOG4CXX_WARN(logger, "Failed to receive an ARP reply on " << subnet.interface << ": " << strerror(errno));
+      return;
+    }
+
+    // replies which arrive outside of a sweep are only drained
+    if (sightings == NULL || subnet.replied.empty() || static_cast<size_t>(length) < sizeof(reply) || ntohs(reply.arp_op) != ARPOP_REPLY ||
+        ntohs(reply.arp_pro) != ETHERTYPE_IP || memcmp(reply.arp_tpa, &subnet.localIp, sizeof(in_addr_t)) != 0)
+      continue;
+
+    Sighting sighting;
+    memcpy(sighting.mac, reply.arp_sha, ETH_ALEN);
+    memcpy(&sighting.ip, reply.arp_spa, sizeof(in_addr_t));
+    const uint32_t offset = ntohl(sighting.ip) - subnet.network;
+    if (offset >= subnet.size || subnet.replied[offset])
+      continue;
+
+    subnet.replied[offset] = 1;
+    sightings->push_back(sighting);
+    ++m_found;
+  }
+}
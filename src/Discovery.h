@@ -0,0 +1,98 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+
+#include <Poco/Timestamp.h>
+
+#include "Sighting.h"
+#include "Timer.h"
+
+// actively sweeps the subnets of interfaces with ARP requests to learn which
+// MAC address currently uses which IP address so that machines can be found
+// again after they got a new DHCP lease, a sweep runs in the background of
+// the event loop one batch of requests at a time
+class Discovery
+{
+  public:
+    Discovery();
+    ~Discovery();
+
+    // adds the subnet of the interface derived from its IP address and
+    // netmask to the sweeps
+    bool Add(const std::string& interface);
+    size_t GetSize() const { return m_subnets.size(); }
+    // becomes readable whenever the sweep in progress needs to be processed
+    int GetDescriptor() const { return m_epoll; }
+    bool IsSweeping() const { return m_sweeping; }
+
+    // starts sending an ARP request to every address of every subnet at no
+    // more than the given rate (requests per second), returns false if a
+    // sweep is still in progress or can't be started
+    bool Start(unsigned int rate);
+    // sends the next batch of requests and appends the MAC and IP address of
+    // every machine which replied since the last call to the sightings
+    void Process(std::vector<Sighting>& sightings);
+
+  private:
+    struct Subnet
+    {
+      std::string interface;
+      int interfaceIndex;
+      uint8_t localMac[ETH_ALEN];
+      in_addr_t localIp;
+      // the network address and the number of addresses in the subnet, both
+      // in host byte order
+      uint32_t network;
+      uint32_t size;
+      int descriptor;
+      // every address is only reported once per sweep
+      std::vector<uint8_t> replied;
+    };
+
+    Discovery(const Discovery&);
+    Discovery& operator=(const Discovery&);
+
+    bool send(const Subnet& subnet, in_addr_t destination);
+    // sends the next batch and arms the timer for the one after it
+    void sendBatch();
+    // receives the pending replies, without sightings they are only drained
+    void receive(Subnet& subnet, std::vector<Sighting>* sightings);
+    void finish();
+
+    std::vector<Subnet> m_subnets;
+    int m_epoll;
+    // paces the batches and then waits for the last replies
+    Timer m_timer;
+
+    bool m_sweeping;
+    Poco::Timestamp::TimeDiff m_pause;
+    // the subnet and the offset within it of the next request
+    size_t m_subnet;
+    uint32_t m_offset;
+    size_t m_sent;
+    size_t m_found;
+    Poco::Timestamp m_start;
+};
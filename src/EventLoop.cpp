@@ -0,0 +1,97 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <log4cxx/logger.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "EventLoop.h"
+
+#define EVENTLOOP_MAX_EVENTS    16
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("EventLoop"));
+
+EventLoop::EventLoop()
+  : m_epoll(-1)
+{
+  m_epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epoll < 0)
+    LOG4CXX_ERROR(logger, "Failed to create an epoll instance: " << strerror(errno));
+}
+
+EventLoop::~EventLoop()
+{
+  if (m_epoll >= 0)
+    close(m_epoll);
+}
+
+bool EventLoop::Add(int descriptor, uint32_t tag)
+{
+  if (m_epoll < 0 || descriptor < 0)
+    return false;
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u32 = tag;
+  if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, descriptor, &event) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to watch descriptor " << descriptor << ": " << strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+bool EventLoop::Remove(int descriptor)
+{
+  if (m_epoll < 0 || descriptor < 0)
+    return false;
+
+  return epoll_ctl(m_epoll, EPOLL_CTL_DEL, descriptor, NULL) == 0;
+}
+
+bool EventLoop::Wait(std::vector<uint32_t>& tags)
+{
+  tags.clear();
+  if (m_epoll < 0)
+    return false;
+
+  struct epoll_event events[EVENTLOOP_MAX_EVENTS];
+  int count;
+  do
+  {
+    count = epoll_wait(m_epoll, events, EVENTLOOP_MAX_EVENTS, -1);
+  } while (count < 0 && errno == EINTR);
+
+  if (count < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to wait for events: " << strerror(errno));
+    return false;
+  }
+
+  for (int event = 0; event < count; ++event)
+    tags.push_back(events[event].data.u32);
+
+  return true;
+}
+
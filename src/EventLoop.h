@@ -0,0 +1,46 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <vector>
+
+#include <stdint.h>
+
+class EventLoop
+{
+  public:
+    EventLoop();
+    ~EventLoop();
+
+    bool IsValid() const { return m_epoll >= 0; }
+
+    bool Add(int descriptor, uint32_t tag);
+    bool Remove(int descriptor);
+
+    // blocks until at least one of the watched descriptors is ready and stores
+    // the tags of all ready descriptors in the given vector
+    bool Wait(std::vector<uint32_t>& tags);
+
+  private:
+    EventLoop(const EventLoop&);
+    EventLoop& operator=(const EventLoop&);
+
+    int m_epoll;
+};
+
@@ -0,0 +1,148 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <log4cxx/logger.h>
+
+#include <Poco/File.h>
+#include <Poco/Path.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "FileWatcher.h"
+
+#define FILEWATCHER_EVENTS      (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE)
+#define FILEWATCHER_BUFFER_SIZE (16 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("FileWatcher"));
+
+FileWatcher::FileWatcher()
+  : m_file(),
+    m_directory(),
+    m_name(),
+    m_inotify(-1),
+    m_watch(-1),
+    m_exists(false)
+{
+  m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_inotify < 0)
+    LOG4CXX_ERROR(logger, "Failed to initialize inotify: " << strerror(errno));
+}
+
+FileWatcher::~FileWatcher()
+{
+  if (m_inotify >= 0)
+    close(m_inotify);
+}
+
+bool FileWatcher::Watch(const std::string& file)
+{
+  if (m_inotify < 0 || file.empty())
+    return false;
+
+  if (m_watch >= 0)
+    inotify_rm_watch(m_inotify, m_watch);
+
+  m_file = file;
+  Poco::Path path(m_file);
+  path.makeAbsolute();
+  m_name = path.getFileName();
+  m_directory = path.parent().toString();
+
+  // the parent directory is watched because the file itself may not exist
+  m_watch = inotify_add_watch(m_inotify, m_directory.c_str(), FILEWATCHER_EVENTS);
+  if (m_watch < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to watch " << m_directory << ": " << strerror(errno));
+    return false;
+  }
+
+  m_exists = exists();
+  return true;
+}
+
+bool FileWatcher::Process()
+{
+  if (m_inotify < 0)
+    return false;
+
+  bool changed = false;
+  char buffer[FILEWATCHER_BUFFER_SIZE] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  while (true)
+  {
+    ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+    if (length <= 0)
+    {
+      if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        LOG4CXX_WARN(logger, "Failed to read events for " << m_directory << ": " << strerror(errno));
+      break;
+    }
+
+    for (char* position = buffer; position < buffer + length; )
+    {
+      const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(position);
+      position += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW)
+      {
+        // events have been lost so the state has to be determined again
+        LOG4CXX_WARN(logger, "Event queue for " << m_directory << " overflowed");
+        m_exists = exists();
+        changed = true;
+        continue;
+      }
+
+      if (event->mask & IN_IGNORED)
+      {
+        LOG4CXX_WARN(logger, m_directory << " is not being watched anymore");
+        m_watch = -1;
+        continue;
+      }
+
+      if (event->len == 0 || m_name.compare(event->name) != 0)
+        continue;
+
+      if (event->mask & (IN_CREATE | IN_MOVED_TO))
+        m_exists = true;
+      else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+        m_exists = false;
+
+      LOG4CXX_TRACE(logger, "Received event " << event->mask << " for " << m_file);
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+bool FileWatcher::exists() const
+{
+  try
+  {
+    return Poco::File(m_file).exists();
+  }
+  catch (Poco::Exception &e)
+  {
+    return false;
+  }
+}
+
@@ -0,0 +1,56 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+
+class FileWatcher
+{
+  public:
+    FileWatcher();
+    ~FileWatcher();
+
+    // starts watching the given file through its parent directory
+    bool Watch(const std::string& file);
+
+    bool IsValid() const { return m_inotify >= 0 && m_watch >= 0; }
+    int GetDescriptor() const { return m_inotify; }
+
+    const std::string& GetFile() const { return m_file; }
+    bool Exists() const { return m_exists; }
+
+    // processes the pending events of the parent directory and returns true
+    // if the watched file has been created, removed or rewritten
+    bool Process();
+
+  private:
+    FileWatcher(const FileWatcher&);
+    FileWatcher& operator=(const FileWatcher&);
+
+    bool exists() const;
+
+    std::string m_file;
+    std::string m_directory;
+    std::string m_name;
+
+    int m_inotify;
+    int m_watch;
+    bool m_exists;
+};
+
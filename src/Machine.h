@@ -20,54 +20,80 @@
 
 #include <string>
 
-#include <Poco/Timestamp.h>
+#include <net/ethernet.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum ProbeType
+{
+  ProbeTypeIcmp = 0,
+  ProbeTypeArp,
+  ProbeTypeTcp,
+  // ICMPv6 echo request
+  ProbeTypeIcmp6,
+  // NDP neighbor solicitation, the advertisement is matched by MAC address
+  ProbeTypeNdp
+} ProbeType;
 
 class Machine
 {
   public:
     Machine()
-    { }
+    {
+      memset(m_mac, 0, sizeof(m_mac));
+    }
     Machine(const std::string& name,
             const std::string& macAddress,
+            const uint8_t* mac,
             const std::string& ipAddress,
             const std::string& username,
             const std::string &password,
-            uint16_t timeout)
+            uint16_t timeout,
+            ProbeType probe = ProbeTypeIcmp,
+            uint16_t port = 0,
+            const std::string& interface = "",
+            const std::string& ipv6Address = "")
       : m_name(name),
         m_macAddress(macAddress),
         m_ipAddress(ipAddress),
         m_username(username),
         m_password(password),
         m_timeout(timeout),
-        m_online(false),
-        m_lastOnline()
-    { }
+        m_probe(probe),
+        m_port(port),
+        m_interface(interface),
+        m_ipv6Address(ipv6Address)
+    {
+      memcpy(m_mac, mac, sizeof(m_mac));
+    }
 
     const std::string& GetName() const { return m_name; }
     const std::string& GetMacAddress() const { return m_macAddress; }
+    const uint8_t* GetMac() const { return m_mac; }
     const std::string& GetIpAddress() const { return m_ipAddress; }
+    void SetIpAddress(const std::string& ipAddress) { m_ipAddress = ipAddress; }
     const std::string& GetUsername() const { return m_username; }
     const std::string& GetPassword() const { return m_password; }
     const uint16_t GetTimeout() const { return m_timeout; }
-
-    const bool IsOnline() const { return m_online; }
-    void SetOnline(bool online)
-    {
-      m_online = online;
-      if (m_online)
-        m_lastOnline.update();
-    }
-
-    const Poco::Timestamp& GetLastOnline() const { return m_lastOnline; }
+    ProbeType GetProbe() const { return m_probe; }
+    uint16_t GetPort() const { return m_port; }
+    // the machine is reached through the default interface if it is empty
+    const std::string& GetInterface() const { return m_interface; }
+    // IPv6 probes go to the link-local address derived from the MAC address
+    // if it is empty
+    const std::string& GetIpv6Address() const { return m_ipv6Address; }
 
   private:
     std::string m_name;
     std::string m_macAddress;
+    uint8_t m_mac[ETH_ALEN];
     std::string m_ipAddress;
     std::string m_username;
     std::string m_password;
     uint16_t m_timeout;
-    bool m_online;
-    Poco::Timestamp m_lastOnline;
+    ProbeType m_probe;
+    uint16_t m_port;
+    std::string m_interface;
+    std::string m_ipv6Address;
 };
 
@@ -0,0 +1,192 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+
+#include <log4cxx/logger.h>
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#include "Clock.h"
+#include "Machine.h"
+#include "MachineRegistry.h"
+
+#define SECONDS_TO_MICROSECONDS 1000000
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("MachineRegistry"));
+
+MachineRegistry::MachineRegistry()
+  : m_machines(),
+    m_ips(),
+    m_ipv6s(),
+    m_macs(),
+    m_timeouts(),
+    m_online(),
+    m_lastSeen(),
+    m_ipIndex(),
+    m_macIndex()
+{ }
+
+MachineId MachineRegistry::Add(Machine& machine)
+{
+  MachineId id = static_cast<MachineId>(m_machines.size());
+  m_machines.push_back(&machine);
+
+  in_addr_t ip;
+  if (inet_pton(AF_INET, machine.GetIpAddress().c_str(), &ip) != 1)
+  {
+    LOG4CXX_WARN(logger, "Invalid IP address " << machine.GetIpAddress() << " of " << machine.GetName());
+    ip = INADDR_ANY;
+  }
+  m_ips.push_back(ip);
+
+  // without an IPv6 address the machine is expected to use the EUI-64 based
+  // link-local one which doesn't change with its privacy addresses
+  struct in6_addr ipv6 = in6addr_any;
+  const uint8_t* mac = machine.GetMac();
+  if (!machine.GetIpv6Address().empty())
+  {
+    if (inet_pton(AF_INET6, machine.GetIpv6Address().c_str(), &ipv6) != 1)
+    {
+      LOG4CXX_WARN(logger, "Invalid IPv6 address " << machine.GetIpv6Address() << " of " << machine.GetName());
+      ipv6 = in6addr_any;
+    }
+  }
+  else if (MacToKey(mac) != 0)
+  {
+    ipv6.s6_addr[0] = 0xFE;
+    ipv6.s6_addr[1] = 0x80;
+    ipv6.s6_addr[8] = mac[0] ^ 0x02;
+    ipv6.s6_addr[9] = mac[1];
+    ipv6.s6_addr[10] = mac[2];
+    ipv6.s6_addr[11] = 0xFF;
+    ipv6.s6_addr[12] = 0xFE;
+    ipv6.s6_addr[13] = mac[3];
+    ipv6.s6_addr[14] = mac[4];
+    ipv6.s6_addr[15] = mac[5];
+  }
+  m_ipv6s.push_back(ipv6);
+  m_macs.insert(m_macs.end(), machine.GetMac(), machine.GetMac() + ETH_ALEN);
+  m_timeouts.push_back(static_cast<Poco::Timestamp::TimeDiff>(machine.GetTimeout()) * SECONDS_TO_MICROSECONDS);
+
+  m_online.Resize(m_machines.size());
+  m_lastSeen.push_back(Clock::Now());
+
+  if (ip != INADDR_ANY)
+  {
+    std::pair<in_addr_t, MachineId> entry(ip, id);
+    m_ipIndex.insert(std::upper_bound(m_ipIndex.begin(), m_ipIndex.end(), entry), entry);
+  }
+
+  uint64_t key = MacToKey(mac);
+  if (key != 0)
+  {
+    std::pair<uint64_t, MachineId> entry(key, id);
+    m_macIndex.insert(std::upper_bound(m_macIndex.begin(), m_macIndex.end(), entry), entry);
+  }
+
+  return id;
+}
+
+void MachineRegistry::SetOnline(MachineId id, bool online)
+{
+  if (online)
+  {
+    m_online.Set(id);
+    m_lastSeen[id] = Clock::Now();
+  }
+  else
+    m_online.Clear(id);
+}
+
+void MachineRegistry::Restore(MachineId id, bool online, const Poco::Timestamp& lastSeen)
+{
+  if (online)
+    m_online.Set(id);
+  else
+    m_online.Clear(id);
+  m_lastSeen[id] = lastSeen;
+}
+
+void MachineRegistry::SetIp(MachineId id, in_addr_t ip)
+{
+  if (m_ips[id] != INADDR_ANY)
+  {
+    std::vector< std::pair<in_addr_t, MachineId> >::iterator entry =
+      std::lower_bound(m_ipIndex.begin(), m_ipIndex.end(), std::make_pair(m_ips[id], id));
+    if (entry != m_ipIndex.end() && entry->first == m_ips[id] && entry->second == id)
+      m_ipIndex.erase(entry);
+  }
+
+  m_ips[id] = ip;
+  if (ip != INADDR_ANY)
+  {
+    std::pair<in_addr_t, MachineId> entry(ip, id);
+    m_ipIndex.insert(std::upper_bound(m_ipIndex.begin(), m_ipIndex.end(), entry), entry);
+  }
+
+  // the address is also used for everything but probing (e.g. SSH)
+  char address[INET_ADDRSTRLEN] = { 0 };
+  if (inet_ntop(AF_INET, &ip, address, sizeof(address)) != NULL)
+    m_machines[id]->SetIpAddress(address);
+}
+
+bool MachineRegistry::Find(const Sighting& sighting, MachineId& id) const
+{
+  if (FindMac(sighting.mac, id))
+    return true;
+
+  if (sighting.ip != INADDR_ANY)
+  {
+    std::vector< std::pair<in_addr_t, MachineId> >::const_iterator entry =
+      std::lower_bound(m_ipIndex.begin(), m_ipIndex.end(), std::make_pair(sighting.ip, static_cast<MachineId>(0)));
+    if (entry != m_ipIndex.end() && entry->first == sighting.ip)
+    {
+      id = entry->second;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool MachineRegistry::FindMac(const uint8_t* mac, MachineId& id) const
+{
+  uint64_t key = MacToKey(mac);
+  if (key == 0)
+    return false;
+
+  std::vector< std::pair<uint64_t, MachineId> >::const_iterator entry =
+    std::lower_bound(m_macIndex.begin(), m_macIndex.end(), std::make_pair(key, static_cast<MachineId>(0)));
+  if (entry == m_macIndex.end() || entry->first != key)
+    return false;
+
+  id = entry->second;
+  return true;
+}
+
+uint64_t MachineRegistry::MacToKey(const uint8_t* mac)
+{
+  uint64_t key = 0;
+  for (size_t index = 0; index < ETH_ALEN; ++index)
+    key = (key << 8) | mac[index];
+
+  return key;
+}
@@ -0,0 +1,87 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <utility>
+#include <vector>
+
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+
+#include <Poco/Timestamp.h>
+
+#include "MachineSet.h"
+#include "Sighting.h"
+
+class Machine;
+
+// assigns every monitored machine a dense identifier and keeps the data
+// needed on every probe round in contiguous arrays indexed by it
+class MachineRegistry
+{
+  public:
+    MachineRegistry();
+
+    MachineId Add(Machine& machine);
+    size_t GetSize() const { return m_machines.size(); }
+
+    Machine& GetMachine(MachineId id) { return *m_machines[id]; }
+    const Machine& GetMachine(MachineId id) const { return *m_machines[id]; }
+
+    // the IP address is INADDR_ANY if the configured one is invalid
+    in_addr_t GetIp(MachineId id) const { return m_ips[id]; }
+    // re-binds the machine to another IP address (e.g. a new DHCP lease)
+    void SetIp(MachineId id, in_addr_t ip);
+    // the unspecified address if the configured one is invalid
+    const struct in6_addr& GetIpv6(MachineId id) const { return m_ipv6s[id]; }
+    const uint8_t* GetMac(MachineId id) const { return &m_macs[static_cast<size_t>(id) * ETH_ALEN]; }
+    Poco::Timestamp::TimeDiff GetTimeout(MachineId id) const { return m_timeouts[id]; }
+
+    bool IsOnline(MachineId id) const { return m_online.Test(id); }
+    const MachineSet& GetOnline() const { return m_online; }
+    // marking a machine as online also updates the time it was last seen
+    void SetOnline(MachineId id, bool online);
+    const Poco::Timestamp& GetLastSeen(MachineId id) const { return m_lastSeen[id]; }
+    // takes over the state of a machine from a previous registry
+    void Restore(MachineId id, bool online, const Poco::Timestamp& lastSeen);
+
+    // looks up a machine by the MAC or IP address of the sighting, a zero
+    // MAC address never matches
+    bool Find(const Sighting& sighting, MachineId& id) const;
+    bool FindMac(const uint8_t* mac, MachineId& id) const;
+
+    // packs a MAC address into an integer to sort and compare it by
+    static uint64_t MacToKey(const uint8_t* mac);
+
+  private:
+    std::vector<Machine*> m_machines;
+    std::vector<in_addr_t> m_ips;
+    std::vector<struct in6_addr> m_ipv6s;
+    std::vector<uint8_t> m_macs;
+    std::vector<Poco::Timestamp::TimeDiff> m_timeouts;
+
+    MachineSet m_online;
+    std::vector<Poco::Timestamp> m_lastSeen;
+
+    // sorted lookup tables to match sightings against
+    std::vector< std::pair<in_addr_t, MachineId> > m_ipIndex;
+    std::vector< std::pair<uint64_t, MachineId> > m_macIndex;
+};
+
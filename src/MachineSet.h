@@ -0,0 +1,89 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// dense identifier of a machine in the MachineRegistry
+typedef uint32_t MachineId;
+
+// set of machine identifiers stored as a bitset
+class MachineSet
+{
+  public:
+    MachineSet()
+      : m_words(),
+        m_size(0)
+    { }
+
+    size_t GetSize() const { return m_size; }
+
+    // removes all identifiers and makes room for the given number of them,
+    // the memory is only reallocated if the set needs to grow
+    void Reset(size_t size)
+    {
+      m_words.assign((size + 63) / 64, 0);
+      m_size = size;
+    }
+    // makes room for the given number of identifiers keeping the current ones
+    void Resize(size_t size)
+    {
+      m_words.resize((size + 63) / 64, 0);
+      m_size = size;
+    }
+
+    bool Test(MachineId id) const { return (m_words[id / 64] & (UINT64_C(1) << (id % 64))) != 0; }
+    void Set(MachineId id) { m_words[id / 64] |= UINT64_C(1) << (id % 64); }
+    void Clear(MachineId id) { m_words[id / 64] &= ~(UINT64_C(1) << (id % 64)); }
+
+    size_t Count() const
+    {
+      size_t count = 0;
+      for (std::vector<uint64_t>::const_iterator word = m_words.begin(); word != m_words.end(); ++word)
+        count += static_cast<size_t>(__builtin_popcountll(*word));
+      return count;
+    }
+
+    // returns the first identifier in the set starting at the given one or
+    // GetSize() if there is none
+    MachineId Next(MachineId id) const
+    {
+      size_t index = id / 64;
+      if (index >= m_words.size())
+        return static_cast<MachineId>(m_size);
+
+      uint64_t word = m_words[index] & (~UINT64_C(0) << (id % 64));
+      while (word == 0)
+      {
+        if (++index >= m_words.size())
+          return static_cast<MachineId>(m_size);
+        word = m_words[index];
+      }
+
+      return static_cast<MachineId>(index * 64 + static_cast<size_t>(__builtin_ctzll(word)));
+    }
+
+  private:
+    std::vector<uint64_t> m_words;
+    size_t m_size;
+};
+
@@ -0,0 +1,214 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "Metrics.h"
+
+#define METRICS_PREFIX          "home_monitor_"
+
+static const Poco::Timestamp::TimeDiff BucketBounds[METRICS_BUCKETS] = {
+  500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+  1000000, 2500000, 5000000, 10000000, 30000000, 60000000, 120000000, 300000000
+};
+
+static void writeSeconds(std::ostream& stream, uint64_t microseconds)
+{
+  stream << microseconds / 1000000 << '.';
+  char fraction[7];
+  uint64_t remainder = microseconds % 1000000;
+  for (int digit = 5; digit >= 0; --digit)
+  {
+    fraction[digit] = static_cast<char>('0' + remainder % 10);
+    remainder /= 10;
+  }
+  fraction[6] = '\0';
+  stream << fraction;
+}
+
+static std::string label(const std::string& name, const std::string& value)
+{
+  std::string escaped;
+  escaped.reserve(value.size());
+  for (std::string::const_iterator character = value.begin(); character != value.end(); ++character)
+  {
+    if (*character == '\\' || *character == '"')
+      escaped += '\\';
+    if (*character == '\n')
+      escaped += "\\n";
+    else
+      escaped += *character;
+  }
+
+  return name + "=\"" + escaped + "\"";
+}
+
+static void writeHeader(std::ostream& stream, const char* name, const char* type, const char* help)
+{
+  stream << "# HELP " METRICS_PREFIX << name << ' ' << help << '\n';
+  stream << "# TYPE " METRICS_PREFIX << name << ' ' << type << '\n';
+}
+
+static void writeValue(std::ostream& stream, const char* name, const std::string& labels, int64_t value)
+{
+  stream << METRICS_PREFIX << name;
+  if (!labels.empty())
+    stream << '{' << labels << '}';
+  stream << ' ' << value << '\n';
+}
+
+Histogram::Histogram()
+  : m_sum(0)
+{
+  for (size_t bucket = 0; bucket <= METRICS_BUCKETS; ++bucket)
+    m_buckets[bucket] = 0;
+}
+
+void Histogram::Observe(Poco::Timestamp::TimeDiff microseconds)
+{
+  if (microseconds < 0)
+    microseconds = 0;
+
+  size_t bucket = 0;
+  while (bucket < METRICS_BUCKETS && microseconds > BucketBounds[bucket])
+    ++bucket;
+
+  __atomic_fetch_add(&m_buckets[bucket], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&m_sum, static_cast<uint64_t>(microseconds), __ATOMIC_RELAXED);
+}
+
+void Histogram::Write(std::ostream& stream, const std::string& name, const std::string& labels) const
+{
+  const std::string prefix = labels.empty() ? "" : labels + ",";
+
+  // the buckets are counted individually and only accumulated here
+  uint64_t cumulative = 0;
+  for (size_t bucket = 0; bucket < METRICS_BUCKETS; ++bucket)
+  {
+    cumulative += __atomic_load_n(&m_buckets[bucket], __ATOMIC_RELAXED);
+    stream << METRICS_PREFIX << name << "_bucket{" << prefix << "le=\"";
+    writeSeconds(stream, static_cast<uint64_t>(BucketBounds[bucket]));
+    stream << "\"} " << cumulative << '\n';
+  }
+  cumulative += __atomic_load_n(&m_buckets[METRICS_BUCKETS], __ATOMIC_RELAXED);
+  stream << METRICS_PREFIX << name << "_bucket{" << prefix << "le=\"+Inf\"} " << cumulative << '\n';
+
+  stream << METRICS_PREFIX << name << "_sum";
+  if (!labels.empty())
+    stream << '{' << labels << '}';
+  stream << ' ';
+  writeSeconds(stream, __atomic_load_n(&m_sum, __ATOMIC_RELAXED));
+  stream << '\n';
+
+  // the count has to match the +Inf bucket even while it is being updated
+  stream << METRICS_PREFIX << name << "_count";
+  if (!labels.empty())
+    stream << '{' << labels << '}';
+  stream << ' ' << cumulative << '\n';
+}
+
+Metrics::Metrics()
+  : m_loopWakeups(),
+    m_rounds(),
+    m_probes(),
+    m_replies(),
+    m_roundDuration(),
+    m_mutex(),
+    m_machines(),
+    m_servers()
+{ }
+
+Metrics::~Metrics()
+{
+  for (std::map<std::string, MachineMetrics*>::iterator machine = m_machines.begin(); machine != m_machines.end(); ++machine)
+    delete machine->second;
+  for (std::map<std::string, ServerMetrics*>::iterator server = m_servers.begin(); server != m_servers.end(); ++server)
+    delete server->second;
+}
+
+MachineMetrics& Metrics::GetMachine(const std::string& name)
+{
+  Poco::Mutex::ScopedLock lock(m_mutex);
+  std::map<std::string, MachineMetrics*>::iterator machine = m_machines.find(name);
+  if (machine == m_machines.end())
+    machine = m_machines.insert(std::make_pair(name, new MachineMetrics())).first;
+
+  return *machine->second;
+}
+
+ServerMetrics& Metrics::GetServer(const std::string& name)
+{
+  Poco::Mutex::ScopedLock lock(m_mutex);
+  std::map<std::string, ServerMetrics*>::iterator server = m_servers.find(name);
+  if (server == m_servers.end())
+    server = m_servers.insert(std::make_pair(name, new ServerMetrics())).first;
+
+  return *server->second;
+}
+
+void Metrics::Write(std::ostream& stream) const
+{
+  writeHeader(stream, "loop_wakeups_total", "counter", "Number of times the main loop has woken up.");
+  writeValue(stream, "loop_wakeups_total", "", static_cast<int64_t>(m_loopWakeups.Get()));
+  writeHeader(stream, "probe_rounds_total", "counter", "Number of probe rounds.");
+  writeValue(stream, "probe_rounds_total", "", static_cast<int64_t>(m_rounds.Get()));
+  writeHeader(stream, "probes_sent_total", "counter", "Number of probes sent.");
+  writeValue(stream, "probes_sent_total", "", static_cast<int64_t>(m_probes.Get()));
+  writeHeader(stream, "probe_replies_total", "counter", "Number of probe replies received.");
+  writeValue(stream, "probe_replies_total", "", static_cast<int64_t>(m_replies.Get()));
+  writeHeader(stream, "probe_round_duration_seconds", "histogram", "Duration of a probe round.");
+  m_roundDuration.Write(stream, "probe_round_duration_seconds", "");
+
+  Poco::Mutex::ScopedLock lock(m_mutex);
+
+  writeHeader(stream, "machine_online", "gauge", "Whether the machine is considered online.");
+  for (std::map<std::string, MachineMetrics*>::const_iterator machine = m_machines.begin(); machine != m_machines.end(); ++machine)
+    writeValue(stream, "machine_online", label("machine", machine->first), machine->second->online.Get());
+  writeHeader(stream, "machine_probes_total", "counter", "Number of probes sent to the machine.");
+  for (std::map<std::string, MachineMetrics*>::const_iterator machine = m_machines.begin(); machine != m_machines.end(); ++machine)
+    writeValue(stream, "machine_probes_total", label("machine", machine->first), static_cast<int64_t>(machine->second->probes.Get()));
+  writeHeader(stream, "machine_replies_total", "counter", "Number of probe replies received from the machine.");
+  for (std::map<std::string, MachineMetrics*>::const_iterator machine = m_machines.begin(); machine != m_machines.end(); ++machine)
+    writeValue(stream, "machine_replies_total", label("machine", machine->first), static_cast<int64_t>(machine->second->replies.Get()));
+  writeHeader(stream, "machine_rtt_seconds", "histogram", "Round trip time of the probes of the machine.");
+  for (std::map<std::string, MachineMetrics*>::const_iterator machine = m_machines.begin(); machine != m_machines.end(); ++machine)
+    machine->second->roundTrip.Write(stream, "machine_rtt_seconds", label("machine", machine->first));
+
+  writeHeader(stream, "server_wakes_total", "counter", "Number of attempts to wake the server up.");
+  for (std::map<std::string, ServerMetrics*>::const_iterator server = m_servers.begin(); server != m_servers.end(); ++server)
+  {
+    writeValue(stream, "server_wakes_total", label("server", server->first) + ",result=\"success\"",
+               static_cast<int64_t>(server->second->wakeSuccesses.Get()));
+    writeValue(stream, "server_wakes_total", label("server", server->first) + ",result=\"failure\"",
+               static_cast<int64_t>(server->second->wakeFailures.Get()));
+  }
+  writeHeader(stream, "server_wake_duration_seconds", "histogram", "Time from waking the server up until it has been seen.");
+  for (std::map<std::string, ServerMetrics*>::const_iterator server = m_servers.begin(); server != m_servers.end(); ++server)
+    server->second->wakeDuration.Write(stream, "server_wake_duration_seconds", label("server", server->first));
+
+  writeHeader(stream, "server_shutdowns_total", "counter", "Number of attempts to shut the server down.");
+  for (std::map<std::string, ServerMetrics*>::const_iterator server = m_servers.begin(); server != m_servers.end(); ++server)
+  {
+    writeValue(stream, "server_shutdowns_total", label("server", server->first) + ",result=\"success\"",
+               static_cast<int64_t>(server->second->shutdownSuccesses.Get()));
+    writeValue(stream, "server_shutdowns_total", label("server", server->first) + ",result=\"failure\"",
+               static_cast<int64_t>(server->second->shutdownFailures.Get()));
+  }
+  writeHeader(stream, "server_shutdown_duration_seconds", "histogram", "Time it took to shut the server down over SSH.");
+  for (std::map<std::string, ServerMetrics*>::const_iterator server = m_servers.begin(); server != m_servers.end(); ++server)
+    server->second->shutdownDuration.Write(stream, "server_shutdown_duration_seconds", label("server", server->first));
+}
@@ -0,0 +1,130 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <map>
+#include <ostream>
+#include <string>
+
+#include <stdint.h>
+
+#include <Poco/Mutex.h>
+#include <Poco/Timestamp.h>
+
+// upper bounds of the histogram buckets in microseconds
+#define METRICS_BUCKETS         18
+
+// all metrics are updated with relaxed atomic operations so that the probing
+// never has to wait for a scrape
+
+class Counter
+{
+  public:
+    Counter() : m_value(0) { }
+
+    void Increment(uint64_t value = 1) { __atomic_fetch_add(&m_value, value, __ATOMIC_RELAXED); }
+    uint64_t Get() const { return __atomic_load_n(&m_value, __ATOMIC_RELAXED); }
+
+  private:
+    uint64_t m_value;
+};
+
+class Gauge
+{
+  public:
+    Gauge() : m_value(0) { }
+
+    void Set(int64_t value) { __atomic_store_n(&m_value, value, __ATOMIC_RELAXED); }
+    int64_t Get() const { return __atomic_load_n(&m_value, __ATOMIC_RELAXED); }
+
+  private:
+    int64_t m_value;
+};
+
+class Histogram
+{
+  public:
+    Histogram();
+
+    void Observe(Poco::Timestamp::TimeDiff microseconds);
+    // writes the buckets, sum and count of the histogram with the given
+    // name and labels (without braces)
+    void Write(std::ostream& stream, const std::string& name, const std::string& labels) const;
+
+  private:
+    uint64_t m_buckets[METRICS_BUCKETS + 1];
+    uint64_t m_sum;
+};
+
+typedef struct MachineMetrics
+{
+  Counter probes;
+  Counter replies;
+  Histogram roundTrip;
+  Gauge online;
+} MachineMetrics;
+
+typedef struct ServerMetrics
+{
+  Counter wakeSuccesses;
+  Counter wakeFailures;
+  // from sending the magic packet until the server has been seen
+  Histogram wakeDuration;
+  Counter shutdownSuccesses;
+  Counter shutdownFailures;
+  Histogram shutdownDuration;
+} ServerMetrics;
+
+class Metrics
+{
+  public:
+    Metrics();
+    ~Metrics();
+
+    // the metrics of a machine or server are created the first time they are
+    // asked for and stay around until the end so that references to them
+    // never become invalid
+    MachineMetrics& GetMachine(const std::string& name);
+    ServerMetrics& GetServer(const std::string& name);
+
+    Counter& GetLoopWakeups() { return m_loopWakeups; }
+    Counter& GetRounds() { return m_rounds; }
+    Counter& GetProbes() { return m_probes; }
+    Counter& GetReplies() { return m_replies; }
+    Histogram& GetRoundDuration() { return m_roundDuration; }
+
+    // writes all metrics in the Prometheus text format
+    void Write(std::ostream& stream) const;
+
+  private:
+    Metrics(const Metrics&);
+    Metrics& operator=(const Metrics&);
+
+    Counter m_loopWakeups;
+    Counter m_rounds;
+    Counter m_probes;
+    Counter m_replies;
+    Histogram m_roundDuration;
+
+    // only protects adding to and iterating over the maps
+    mutable Poco::Mutex m_mutex;
+    std::map<std::string, MachineMetrics*> m_machines;
+    std::map<std::string, ServerMetrics*> m_servers;
+};
+
@@ -0,0 +1,148 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <sstream>
+
+#include <log4cxx/logger.h>
+
+#include <Poco/Exception.h>
+#include <Poco/Net/HTTPRequestHandler.h>
+#include <Poco/Net/HTTPRequestHandlerFactory.h>
+#include <Poco/Net/HTTPServer.h>
+#include <Poco/Net/HTTPServerParams.h>
+#include <Poco/Net/HTTPServerRequest.h>
+#include <Poco/Net/HTTPServerResponse.h>
+#include <Poco/Net/ServerSocket.h>
+#include <Poco/Net/SocketAddress.h>
+
+#include "Metrics.h"
+#include "MetricsServer.h"
+
+#define METRICS_PATH            "/metrics"
+#define METRICS_CONTENT_TYPE    "text/plain; version=0.0.4"
+
+using namespace Poco::Net;
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("MetricsServer"));
+
+class MetricsRequestHandler : public HTTPRequestHandler
+{
+  public:
+    MetricsRequestHandler(const Metrics& metrics)
+      : m_metrics(metrics)
+    { }
+
+    virtual void handleRequest(HTTPServerRequest& request, HTTPServerResponse& response)
+    {
+      if (request.getURI() != METRICS_PATH)
+      {
+        response.setStatusAndReason(HTTPResponse::HTTP_NOT_FOUND);
+        response.setContentLength(0);
+        response.send();
+        return;
+      }
+
+      if (request.getMethod() != HTTPRequest::HTTP_GET && request.getMethod() != HTTPRequest::HTTP_HEAD)
+      {
+        response.setStatusAndReason(HTTPResponse::HTTP_METHOD_NOT_ALLOWED);
+        response.setContentLength(0);
+        response.send();
+        return;
+      }
+
+      // render everything first so the length is known
+      std::ostringstream body;
+      m_metrics.Write(body);
+      const std::string content = body.str();
+
+      response.setStatusAndReason(HTTPResponse::HTTP_OK);
+      response.setContentType(METRICS_CONTENT_TYPE);
+      response.setContentLength(static_cast<long>(content.size()));
+      std::ostream& stream = response.send();
+      if (request.getMethod() == HTTPRequest::HTTP_GET)
+        stream << content;
+    }
+
+  private:
+    const Metrics& m_metrics;
+};
+
+class MetricsRequestHandlerFactory : public HTTPRequestHandlerFactory
+{
+  public:
+    MetricsRequestHandlerFactory(const Metrics& metrics)
+      : m_metrics(metrics)
+    { }
+
+    virtual HTTPRequestHandler* createRequestHandler(const HTTPServerRequest& request)
+    {
+      return new MetricsRequestHandler(m_metrics);
+    }
+
+  private:
+    const Metrics& m_metrics;
+};
+
+MetricsServer::MetricsServer(const Metrics& metrics)
+  : m_metrics(metrics),
+    m_server(NULL)
+{ }
+
+MetricsServer::~MetricsServer()
+{
+  Stop();
+}
+
+bool MetricsServer::Start(const std::string& address, uint16_t port)
+{
+  Stop();
+
+  try
+  {
+    ServerSocket socket(SocketAddress(address, port));
+
+    // scrapes are rare, a single thread is enough
+    HTTPServerParams* params = new HTTPServerParams();
+    params->setMaxThreads(1);
+    params->setMaxQueued(4);
+    params->setKeepAlive(false);
+
+    m_server = new HTTPServer(new MetricsRequestHandlerFactory(m_metrics), socket, params);
+    m_server->start();
+  }
+  catch (Poco::Exception &e)
+  {
+    LOG4CXX_ERROR(logger, "Failed to serve the metrics on " << address << ":" << port << ": " << e.displayText());
+    delete m_server;
+    m_server = NULL;
+    return false;
+  }
+
+  return true;
+}
+
+void MetricsServer::Stop()
+{
+  if (m_server == NULL)
+    return;
+
+  m_server->stopAll(true);
+  delete m_server;
+  m_server = NULL;
+}
@@ -0,0 +1,53 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+
+#include <stdint.h>
+
+class Metrics;
+
+namespace Poco
+{
+  namespace Net
+  {
+    class HTTPServer;
+  }
+}
+
+// serves the metrics in the Prometheus text format over HTTP on its own
+// threads
+class MetricsServer
+{
+  public:
+    MetricsServer(const Metrics& metrics);
+    ~MetricsServer();
+
+    bool Start(const std::string& address, uint16_t port);
+    void Stop();
+
+  private:
+    MetricsServer(const MetricsServer&);
+    MetricsServer& operator=(const MetricsServer&);
+
+    const Metrics& m_metrics;
+    Poco::Net::HTTPServer* m_server;
+};
+
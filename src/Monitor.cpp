@@ -0,0 +1,858 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <log4cxx/logger.h>
+
+#include <string.h>
+
+#include "Configuration.h"
+#include "Machine.h"
+#include "Metrics.h"
+#include "Monitor.h"
+#include "Backend.h"
+#include "Clock.h"
+#include "Server.h"
+#include "ShutdownExecutor.h"
+
+#define CHANGE_TIMEOUT          120
+
+#define SECONDS_TO_MICROSECONDS 1000000
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("Monitor"));
+
+Monitor::Monitor(const Configuration& config, Backend& backend, Metrics& metrics)
+  : m_config(config),
+    m_backend(backend),
+    m_metrics(metrics),
+    m_servers(),
+    m_registry(),
+    m_probes(),
+    m_scheduler(),
+    m_dependents(),
+    m_settled(),
+    m_unsettled(0),
+    m_pendingServers(0),
+    m_endedEarly(false),
+    m_available(),
+    m_machineMetrics(),
+    m_stateFile(),
+    m_trace(),
+    m_alwaysOn(false),
+    m_started(false)
+{
+  std::map<std::string, ServerState> previousServers;
+  build(previousServers);
+}
+
+Monitor::~Monitor()
+{
+  for (std::vector<ServerState>::iterator state = m_servers.begin(); state != m_servers.end(); ++state)
+    delete state->shutdownExecutor;
+}
+
+bool Monitor::Start()
+{
+  m_started = true;
+  for (std::vector<ServerState>::iterator state = m_servers.begin(); state != m_servers.end(); ++state)
+  {
+    if (!state->shutdownExecutor->Start())
+      return false;
+  }
+
+  return true;
+}
+
+void Monitor::GetShutdownDescriptors(std::vector<int>& descriptors) const
+{
+  descriptors.clear();
+  for (std::vector<ServerState>::const_iterator state = m_servers.begin(); state != m_servers.end(); ++state)
+  {
+    if (state->shutdownExecutor->GetDescriptor() >= 0)
+      descriptors.push_back(state->shutdownExecutor->GetDescriptor());
+  }
+}
+
+bool Monitor::OpenStateFile(const std::string& path)
+{
+  if (!m_stateFile.Open(path))
+    return false;
+
+  size_t restored = 0;
+  for (MachineId id = 0; id < m_registry.GetSize(); ++id)
+  {
+    in_addr_t ip;
+    bool online;
+    Poco::Timestamp lastSeen, lastChange;
+    if (!m_stateFile.Find(m_registry, id, id < m_servers.size(), ip, online, lastSeen, lastChange))
+      continue;
+
+    // like on a reload an IP address which has been discovered is kept
+    // until the next sweep, only machines with a MAC address can be
+    // discovered at all
+    if (ip != m_registry.GetIp(id) && ip != INADDR_ANY && m_config.GetDiscoveryInterval() > 0 &&
+        MachineRegistry::MacToKey(m_registry.GetMac(id)) != 0)
+      m_registry.SetIp(id, ip);
+
+    // the daemon may have been down for longer than the timeout, a machine
+    // which wasn't seen since must not keep its server awake until the first
+    // expiry
+    if (online && Clock::Elapsed(lastSeen) >= m_registry.GetTimeout(id))
+      online = false;
+
+    m_registry.Restore(id, online, lastSeen);
+    if (id < m_servers.size())
+      m_servers[id].lastChange = lastChange;
+    ++restored;
+  }
+  publishOnline();
+
+  LOG4CXX_INFO(logger, "Restored the state of " << restored << " of " << m_registry.GetSize() << " servers and machines from " << path);
+
+  layoutStateFile();
+  return true;
+}
+
+bool Monitor::OpenTrace(const std::string& path)
+{
+  if (!m_trace.Open(path))
+    return false;
+
+  LOG4CXX_INFO(logger, "Tracing to " << path);
+  traceMachines();
+  m_trace.Flush();
+  return true;
+}
+
+bool Monitor::Restore(const std::string& name, bool server, bool online,
+                      const Poco::Timestamp& lastSeen, const Poco::Timestamp& lastChange)
+{
+  const MachineId first = server ? 0 : static_cast<MachineId>(m_servers.size());
+  const MachineId last = server ? static_cast<MachineId>(m_servers.size()) : static_cast<MachineId>(m_registry.GetSize());
+  for (MachineId id = first; id < last; ++id)
+  {
+    if (m_registry.GetMachine(id).GetName() != name)
+      continue;
+
+    m_registry.Restore(id, online, lastSeen);
+    m_machineMetrics[id]->online.Set(online ? 1 : 0);
+    if (server)
+      m_servers[id].lastChange = lastChange;
+    return true;
+  }
+
+  return false;
+}
+
+void Monitor::Reload(const Configuration& config)
+{
+  // remember the state of the current servers and machines by their name
+  std::map<std::string, ServerState> previousServers;
+  std::map<std::string, MachineState> previousMachines[2];
+  for (MachineId id = 0; id < m_registry.GetSize(); ++id)
+  {
+    MachineState state;
+    state.ip = m_registry.GetIp(id);
+    memcpy(state.mac, m_registry.GetMac(id), ETH_ALEN);
+    state.online = m_registry.IsOnline(id);
+    state.lastSeen = m_registry.GetLastSeen(id);
+
+    // servers and machines may share a name
+    bool isServer = id < m_servers.size();
+    previousMachines[isServer ? 0 : 1].insert(std::make_pair(m_registry.GetMachine(id).GetName(), state));
+    if (isServer && !previousServers.insert(std::make_pair(m_registry.GetMachine(id).GetName(), m_servers[id])).second)
+      delete m_servers[id].shutdownExecutor;
+  }
+
+  // executors can only be kept if their timeouts haven't changed, the rest
+  // of the state of the servers is kept anyway
+  if (config.GetSshConnectTimeout() != m_config.GetSshConnectTimeout() ||
+      config.GetSshExecuteTimeout() != m_config.GetSshExecuteTimeout())
+  {
+    for (std::map<std::string, ServerState>::iterator server = previousServers.begin(); server != previousServers.end(); ++server)
+    {
+      delete server->second.shutdownExecutor;
+      server->second.shutdownExecutor = NULL;
+    }
+  }
+
+  // machines which are removed shouldn't be reported as online anymore
+  for (MachineId id = 0; id < m_registry.GetSize(); ++id)
+    m_machineMetrics[id]->online.Set(0);
+
+  m_config = config;
+  m_servers.clear();
+  m_registry = MachineRegistry();
+  build(previousServers);
+
+  // the executors of removed servers aren't needed anymore
+  for (std::map<std::string, ServerState>::iterator server = previousServers.begin(); server != previousServers.end(); ++server)
+    delete server->second.shutdownExecutor;
+
+  size_t kept = 0;
+  for (MachineId id = 0; id < m_registry.GetSize(); ++id)
+  {
+    const std::map<std::string, MachineState>& states = previousMachines[id < m_servers.size() ? 0 : 1];
+    std::map<std::string, MachineState>::const_iterator state = states.find(m_registry.GetMachine(id).GetName());
+    if (state == states.end() || memcmp(state->second.mac, m_registry.GetMac(id), ETH_ALEN) != 0)
+      continue;
+
+    // an IP address which has been discovered is kept until the next sweep
+    if (state->second.ip != m_registry.GetIp(id))
+    {
+      if (m_config.GetDiscoveryInterval() == 0 || state->second.ip == INADDR_ANY)
+        continue;
+      m_registry.SetIp(id, state->second.ip);
+    }
+
+    m_registry.Restore(id, state->second.online, state->second.lastSeen);
+    ++kept;
+  }
+  publishOnline();
+
+  if (m_stateFile.IsOpen())
+    layoutStateFile();
+  traceMachines();
+
+  LOG4CXX_INFO(logger, "Monitoring " << m_servers.size() << " servers and " << (m_registry.GetSize() - m_servers.size()) << " machines, "
+                       << kept << " of them kept their state");
+}
+
+void Monitor::SetAlwaysOn(bool alwaysOn)
+{
+  if (alwaysOn == m_alwaysOn)
+    return;
+
+  if (alwaysOn) {
+    LOG4CXX_INFO(logger, "Always ON has been enabled");
+  } else {
+    LOG4CXX_INFO(logger, "Always ON has been disabled");
+  }
+
+  m_alwaysOn = alwaysOn;
+  m_trace.WriteValue(TraceRecordAlwaysOn, alwaysOn ? 1 : 0);
+}
+
+void Monitor::Probe(bool everything /* = false */)
+{
+  // machines which are due until halfway to the next round are pinged now
+  // so that they go out together instead of one round later
+  const Poco::Timestamp now = Clock::Now();
+  if (everything)
+    m_scheduler.Reset(m_registry.GetSize(), now);
+
+  m_probes.clear();
+  const Poco::Timestamp::TimeDiff interval = static_cast<Poco::Timestamp::TimeDiff>(m_config.GetPingInterval()) * SECONDS_TO_MICROSECONDS;
+  m_scheduler.TakeDue(now + interval / 2, m_probes);
+  if (m_probes.empty())
+    return;
+
+  // the due machines are pinged in a single round which may end as soon as
+  // the replies can't change any decision anymore
+  std::sort(m_probes.begin(), m_probes.end());
+  PingObserver* observer = NULL;
+  if (m_config.IsPingEarlyExit())
+  {
+    prepareEarlyExit();
+    if (m_unsettled > 0)
+      observer = this;
+  }
+
+  Poco::Timestamp start;
+  size_t replies = m_backend.Ping(m_registry, m_probes, m_config.GetPingTimeout(), m_available, observer);
+  m_metrics.GetRoundDuration().Observe(start.elapsed());
+  m_metrics.GetRounds().Increment();
+  m_metrics.GetProbes().Increment(m_backend.GetSent());
+  m_metrics.GetReplies().Increment(replies);
+
+  const std::vector<Poco::Timestamp::TimeDiff>& roundTrips = m_backend.GetRoundTrips();
+  m_trace.WriteRound(m_probes, roundTrips);
+  for (size_t index = 0; index < m_probes.size(); ++index)
+  {
+    const MachineId id = m_probes[index];
+    MachineMetrics& metrics = *m_machineMetrics[id];
+    metrics.probes.Increment();
+    if (roundTrips[index] >= 0)
+    {
+      metrics.replies.Increment();
+      metrics.roundTrip.Observe(roundTrips[index]);
+    }
+    else if (m_endedEarly)
+    {
+      // the reply hasn't been waited for so the machine is due again
+      m_scheduler.Schedule(id, Clock::Now());
+      continue;
+    }
+
+    update(id, m_available.Test(id));
+    schedule(id);
+  }
+  m_endedEarly = false;
+}
+
+void Monitor::Seen(const Sighting& sighting)
+{
+  MachineId id;
+  if (!m_registry.Find(sighting, id))
+    return;
+
+  LOG4CXX_TRACE(logger, m_registry.GetMachine(id).GetName() << " has been seen on the network");
+  m_trace.WriteSighting(TraceRecordSeen, sighting);
+  update(id, true);
+  schedule(id);
+}
+
+void Monitor::Lost(const Sighting& sighting)
+{
+  MachineId id;
+  if (!m_registry.Find(sighting, id))
+    return;
+
+  LOG4CXX_TRACE(logger, m_registry.GetMachine(id).GetName() << " is unreachable");
+  m_trace.WriteSighting(TraceRecordLost, sighting);
+  update(id, false);
+  schedule(id);
+}
+
+void Monitor::Discovered(const Sighting& sighting)
+{
+  // only the MAC address identifies a machine whose IP address may change
+  MachineId id;
+  if (!m_registry.FindMac(sighting.mac, id))
+    return;
+
+  if (m_registry.GetIp(id) != sighting.ip)
+  {
+    const std::string previous = m_registry.GetMachine(id).GetIpAddress();
+    m_registry.SetIp(id, sighting.ip);
+    m_stateFile.SetIp(id, sighting.ip);
+    LOG4CXX_INFO(logger, m_registry.GetMachine(id).GetName() << " has moved from " << previous << " to " << m_registry.GetMachine(id).GetIpAddress());
+  }
+
+  // an ARP reply only proves presence for machines which are probed that
+  // way, e.g. a sleeping machine whose NIC still answers ARP isn't online
+  if (m_registry.GetMachine(id).GetProbe() == ProbeTypeArp)
+    Seen(sighting);
+}
+
+void Monitor::Expire()
+{
+  m_trace.WriteEvent(TraceRecordExpire);
+
+  // only machines which are online can expire
+  const MachineSet& online = m_registry.GetOnline();
+  for (MachineId id = online.Next(0); id < online.GetSize(); id = online.Next(id + 1))
+    update(id, false);
+}
+
+void Monitor::Decide()
+{
+  m_trace.WriteEvent(TraceRecordDecide);
+  for (std::vector<ServerState>::iterator state = m_servers.begin(); state != m_servers.end(); ++state)
+    decide(*state);
+
+  // the daemon decides once per wakeup which is a good time to write out
+  // everything that happened in between
+  m_trace.Flush();
+}
+
+void Monitor::ShutdownFinished()
+{
+  for (std::vector<ServerState>::iterator state = m_servers.begin(); state != m_servers.end(); ++state)
+  {
+    bool success;
+    if (!state->shutdownExecutor->GetResult(success))
+      continue;
+
+    state->metrics->shutdownDuration.Observe(Clock::Elapsed(state->shutdownStart));
+    m_trace.WriteAction(TraceRecordShutdownFinished, state->server, success ? 1 : 0);
+    if (success)
+    {
+      state->metrics->shutdownSuccesses.Increment();
+      changed(*state);
+    }
+    else
+    {
+      state->metrics->shutdownFailures.Increment();
+      LOG4CXX_ERROR(logger, "Shutting down " << m_registry.GetMachine(state->server).GetName() << " failed");
+    }
+  }
+}
+
+bool Monitor::GetNextDeadline(Poco::Timestamp& deadline) const
+{
+  bool found = false;
+
+  // a machine which is online may time out
+  const MachineSet& online = m_registry.GetOnline();
+  for (MachineId id = online.Next(0); id < online.GetSize(); id = online.Next(id + 1))
+  {
+    Poco::Timestamp timeout = m_registry.GetLastSeen(id) + m_registry.GetTimeout(id);
+    if (!found || timeout < deadline)
+    {
+      deadline = timeout;
+      found = true;
+    }
+  }
+
+  // a pending change may be held off by a previous change, a change which
+  // is already overdue has failed and is retried after the next ping round
+  const Poco::Timestamp now = Clock::Now();
+  for (std::vector<ServerState>::const_iterator state = m_servers.begin(); state != m_servers.end(); ++state)
+  {
+    Poco::Timestamp holdOff = state->lastChange + CHANGE_TIMEOUT * SECONDS_TO_MICROSECONDS;
+    if (!isChangeNeeded(*state) || state->shutdownExecutor->IsBusy() || holdOff <= now)
+      continue;
+
+    if (!found || holdOff < deadline)
+    {
+      deadline = holdOff;
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+void Monitor::build(std::map<std::string, ServerState>& previousServers)
+{
+  // every server gets its own executor so that a slow shutdown of one server
+  // doesn't hold up the others
+  std::vector<Server>& servers = m_config.GetServers();
+  for (std::vector<Server>::iterator server = servers.begin(); server != servers.end(); ++server)
+  {
+    ServerState state;
+    state.shutdownExecutor = NULL;
+    state.hold = HoldNone;
+    state.waking = false;
+
+    // a server which is still around keeps its hold and hold-off, and its
+    // executor unless that had to be dropped
+    std::map<std::string, ServerState>::iterator previous = previousServers.find(server->GetMachine().GetName());
+    if (previous != previousServers.end())
+    {
+      state = previous->second;
+      previousServers.erase(previous);
+    }
+    else
+      state.lastChange = Clock::Now();
+
+    if (state.shutdownExecutor == NULL)
+    {
+      state.shutdownExecutor = m_backend.CreateShutdownExecutor(m_config.GetSshConnectTimeout(), m_config.GetSshExecuteTimeout());
+      if (m_started && !state.shutdownExecutor->Start())
+        LOG4CXX_ERROR(logger, "Failed to start the shutdown executor of " << server->GetMachine().GetName());
+    }
+
+    state.server = m_registry.Add(server->GetMachine());
+    state.clients.clear();
+    state.metrics = &m_metrics.GetServer(server->GetMachine().GetName());
+    m_servers.push_back(state);
+  }
+
+  // the machines follow the servers so their identifiers are offset by the
+  // number of servers
+  const MachineId firstMachine = static_cast<MachineId>(m_registry.GetSize());
+  std::vector<Machine>& machines = m_config.GetMachines();
+  for (std::vector<Machine>::iterator machine = machines.begin(); machine != machines.end(); ++machine)
+    m_registry.Add(*machine);
+
+  m_dependents.assign(m_registry.GetSize(), std::vector<size_t>());
+  for (size_t index = 0; index < servers.size(); ++index)
+  {
+    const std::vector<size_t>& clients = servers[index].GetClients();
+    for (std::vector<size_t>::const_iterator client = clients.begin(); client != clients.end(); ++client)
+    {
+      m_servers[index].clients.push_back(firstMachine + static_cast<MachineId>(*client));
+      m_dependents[firstMachine + *client].push_back(index);
+    }
+  }
+
+  m_machineMetrics.clear();
+  for (MachineId id = 0; id < m_registry.GetSize(); ++id)
+    m_machineMetrics.push_back(&m_metrics.GetMachine(m_registry.GetMachine(id).GetName()));
+  publishOnline();
+
+  m_probes.reserve(m_registry.GetSize());
+  m_available.Reset(m_registry.GetSize());
+  m_scheduler.Reset(m_registry.GetSize(), Clock::Now());
+}
+
+bool Monitor::Wake(const std::string& name, std::ostream& output)
+{
+  m_trace.WriteManual(TraceRecordManualWake, name);
+  std::vector<size_t> servers;
+  if (!findServers(name, servers, output))
+    return false;
+
+  // waking a server up holds off shutting it down like an automatic change
+  bool success = true;
+  for (std::vector<size_t>::const_iterator index = servers.begin(); index != servers.end(); ++index)
+  {
+    ServerState& state = m_servers[*index];
+    const std::string& serverName = m_registry.GetMachine(state.server).GetName();
+    if (wake(state))
+      output << "Waking up " << serverName << "\n";
+    else
+    {
+      output << "Waking up " << serverName << " failed\n";
+      success = false;
+    }
+  }
+
+  return success;
+}
+
+bool Monitor::Shutdown(const std::string& name, std::ostream& output)
+{
+  m_trace.WriteManual(TraceRecordManualShutdown, name);
+  std::vector<size_t> servers;
+  if (!findServers(name, servers, output))
+    return false;
+
+  bool success = true;
+  for (std::vector<size_t>::const_iterator index = servers.begin(); index != servers.end(); ++index)
+  {
+    ServerState& state = m_servers[*index];
+    const std::string& serverName = m_registry.GetMachine(state.server).GetName();
+    if (shutdown(state))
+      output << "Shutting down " << serverName << "\n";
+    else
+    {
+      output << "Shutting down " << serverName << " is already in progress\n";
+      success = false;
+    }
+  }
+
+  return success;
+}
+
+bool Monitor::SetHold(const std::string& name, Hold hold, std::ostream& output)
+{
+  m_trace.WriteManual(TraceRecordHold, name, static_cast<uint8_t>(hold));
+  std::vector<size_t> servers;
+  if (!findServers(name, servers, output))
+    return false;
+
+  static const char* holdNames[] = { "released", "held on", "held off" };
+  for (std::vector<size_t>::const_iterator index = servers.begin(); index != servers.end(); ++index)
+  {
+    ServerState& state = m_servers[*index];
+    const std::string& serverName = m_registry.GetMachine(state.server).GetName();
+    if (state.hold == hold)
+    {
+      output << serverName << " is already " << holdNames[hold] << "\n";
+      continue;
+    }
+
+    // a manual hold takes effect right away
+    state.hold = hold;
+    if (hold != HoldNone)
+      state.lastChange = Poco::Timestamp(0);
+
+    LOG4CXX_INFO(logger, serverName << " has been " << holdNames[hold]);
+    output << serverName << " has been " << holdNames[hold] << "\n";
+  }
+
+  return true;
+}
+
+void Monitor::WriteStatus(std::ostream& output) const
+{
+  static const char* holdNames[] = { "", ", held on", ", held off" };
+
+  output << "Always ON: " << (m_alwaysOn ? "yes" : "no") << "\n";
+  output << "Servers (" << m_servers.size() << ")\n";
+  for (std::vector<ServerState>::const_iterator state = m_servers.begin(); state != m_servers.end(); ++state)
+  {
+    const Machine& server = m_registry.GetMachine(state->server);
+    output << "\t" << server.GetName() << ": " << (m_registry.IsOnline(state->server) ? "online" : "offline")
+           << holdNames[state->hold];
+    if (state->shutdownExecutor->IsBusy())
+      output << ", shutting down";
+    if (state->lastChange.epochMicroseconds() > 0)
+      output << ", last change " << Clock::Elapsed(state->lastChange) / SECONDS_TO_MICROSECONDS << "s ago";
+    output << "\n";
+
+    for (std::vector<MachineId>::const_iterator client = state->clients.begin(); client != state->clients.end(); ++client)
+      output << "\t\t" << m_registry.GetMachine(*client).GetName() << "\n";
+  }
+
+  output << "Machines (" << m_registry.GetSize() - m_servers.size() << ")\n";
+  for (MachineId id = static_cast<MachineId>(m_servers.size()); id < m_registry.GetSize(); ++id)
+  {
+    output << "\t" << m_registry.GetMachine(id).GetName() << ": " << (m_registry.IsOnline(id) ? "online" : "offline");
+    if (m_registry.IsOnline(id))
+      output << ", last seen " << Clock::Elapsed(m_registry.GetLastSeen(id)) / SECONDS_TO_MICROSECONDS << "s ago";
+    output << "\n";
+  }
+}
+
+void Monitor::layoutStateFile()
+{
+  m_stateFile.Layout(m_registry, m_servers.size());
+  for (std::vector<ServerState>::const_iterator state = m_servers.begin(); state != m_servers.end(); ++state)
+    m_stateFile.SetLastChange(state->server, state->lastChange);
+}
+
+void Monitor::traceMachines()
+{
+  if (!m_trace.IsOpen())
+    return;
+
+  std::vector<Poco::Timestamp> lastChanges;
+  for (std::vector<ServerState>::const_iterator state = m_servers.begin(); state != m_servers.end(); ++state)
+    lastChanges.push_back(state->lastChange);
+  m_trace.WriteMachines(m_registry, lastChanges);
+}
+
+void Monitor::publishOnline()
+{
+  for (MachineId id = 0; id < m_registry.GetSize(); ++id)
+    m_machineMetrics[id]->online.Set(m_registry.IsOnline(id) ? 1 : 0);
+}
+
+void Monitor::changed(ServerState& state)
+{
+  state.lastChange = Clock::Now();
+  m_stateFile.SetLastChange(state.server, state.lastChange);
+}
+
+void Monitor::update(MachineId id, bool available)
+{
+  bool wasAvailable = m_registry.IsOnline(id);
+  if (available)
+    m_registry.SetOnline(id, true);
+  else if (wasAvailable)
+  {
+    // check if the machine hasn't been online for a while
+    if (Clock::Elapsed(m_registry.GetLastSeen(id)) >= m_registry.GetTimeout(id))
+      m_registry.SetOnline(id, false);
+  }
+
+  // the mapped state file only needs a couple of stores
+  if (available || m_registry.IsOnline(id) != wasAvailable)
+    m_stateFile.SetOnline(id, m_registry.IsOnline(id), m_registry.GetLastSeen(id));
+
+  if (m_registry.IsOnline(id) != wasAvailable)
+  {
+    m_machineMetrics[id]->online.Set(wasAvailable ? 0 : 1);
+
+    // a server which has been woken up is finally there
+    if (!wasAvailable && id < m_servers.size() && m_servers[id].waking)
+    {
+      m_servers[id].metrics->wakeDuration.Observe(Clock::Elapsed(m_servers[id].wakeStart));
+      m_servers[id].waking = false;
+    }
+
+    const Machine& machine = m_registry.GetMachine(id);
+    if (wasAvailable) {
+      LOG4CXX_INFO(logger, machine.GetName() << " is not available aynmore");
+    } else {
+      LOG4CXX_INFO(logger, machine.GetName() << " is now available");
+    }
+  }
+}
+
+void Monitor::schedule(MachineId id)
+{
+  const Poco::Timestamp now = Clock::Now();
+  const Poco::Timestamp::TimeDiff interval = static_cast<Poco::Timestamp::TimeDiff>(m_config.GetPingInterval()) * SECONDS_TO_MICROSECONDS;
+
+  // the servers drive every decision so they are always pinged, a machine
+  // which is online only needs to be pinged again shortly before it would
+  // time out (with a second chance if it misses a reply) and one which is
+  // offline is pinged in the background
+  Poco::Timestamp due = now + interval;
+  if (id >= m_servers.size())
+  {
+    if (m_registry.IsOnline(id))
+      due = std::max(due, m_registry.GetLastSeen(id) + m_registry.GetTimeout(id) - 2 * interval);
+    else
+      due = now + static_cast<Poco::Timestamp::TimeDiff>(m_config.GetPingOfflineInterval()) * SECONDS_TO_MICROSECONDS;
+  }
+
+  m_scheduler.Schedule(id, due);
+}
+
+void Monitor::prepareEarlyExit()
+{
+  // only a server which isn't wanted (yet) can be woken up by a reply and
+  // only one which is offline can come online
+  m_endedEarly = false;
+  m_unsettled = 0;
+  m_settled.assign(m_servers.size(), 1);
+  for (size_t index = 0; index < m_servers.size(); ++index)
+  {
+    if (m_servers[index].hold == HoldNone && !isWanted(m_servers[index]))
+    {
+      m_settled[index] = 0;
+      ++m_unsettled;
+    }
+  }
+
+  m_pendingServers = 0;
+  for (std::vector<MachineId>::const_iterator id = m_probes.begin(); id != m_probes.end() && *id < m_servers.size(); ++id)
+  {
+    if (!m_registry.IsOnline(*id))
+      ++m_pendingServers;
+  }
+}
+
+bool Monitor::Replied(size_t index)
+{
+  const MachineId id = m_probes[index];
+  if (id < m_servers.size())
+  {
+    if (!m_registry.IsOnline(id))
+      --m_pendingServers;
+  }
+  else
+  {
+    // the first reply of a client settles the decision for its servers
+    // which are woken up right away instead of after the round
+    const std::vector<size_t>& dependents = m_dependents[id];
+    for (std::vector<size_t>::const_iterator server = dependents.begin(); server != dependents.end(); ++server)
+    {
+      if (m_settled[*server])
+        continue;
+
+      m_settled[*server] = 1;
+      --m_unsettled;
+      update(id, true);
+      decide(m_servers[*server]);
+    }
+  }
+
+  m_endedEarly = m_unsettled == 0 && m_pendingServers == 0;
+  return m_endedEarly;
+}
+
+void Monitor::decide(ServerState& state)
+{
+  const Machine& server = m_registry.GetMachine(state.server);
+  const bool serverOnline = m_registry.IsOnline(state.server);
+  ShutdownExecutor& shutdownExecutor = *state.shutdownExecutor;
+  bool wanted = isWanted(state);
+
+  if ((m_alwaysOn && state.hold == HoldNone) || Clock::Elapsed(state.lastChange) >= CHANGE_TIMEOUT * SECONDS_TO_MICROSECONDS)
+  {
+    if (wanted && !serverOnline)
+      wake(state);
+    else if (!wanted && serverOnline && !shutdownExecutor.IsBusy())
+      shutdown(state);
+  }
+
+  // keep a session to the server around while it is online
+  if (!shutdownExecutor.IsBusy())
+    shutdownExecutor.SetOnline(server, serverOnline);
+}
+
+bool Monitor::wake(ServerState& state)
+{
+  const Machine& server = m_registry.GetMachine(state.server);
+  LOG4CXX_INFO(logger, "Waking up " << server.GetName() << "...");
+  if (!m_backend.Wake(server))
+  {
+    state.metrics->wakeFailures.Increment();
+    LOG4CXX_ERROR(logger, "Waking up " << server.GetName() << " failed");
+    return false;
+  }
+
+  state.metrics->wakeSuccesses.Increment();
+  m_trace.WriteAction(TraceRecordWake, state.server);
+  if (!state.waking)
+  {
+    state.waking = true;
+    state.wakeStart = Clock::Now();
+  }
+  changed(state);
+  return true;
+}
+
+bool Monitor::shutdown(ServerState& state)
+{
+  // the outcome is reported back through ShutdownFinished()
+  const Machine& server = m_registry.GetMachine(state.server);
+  LOG4CXX_INFO(logger, "Shutting down " << server.GetName() << "...");
+  if (!state.shutdownExecutor->Shutdown(server))
+    return false;
+
+  state.shutdownStart = Clock::Now();
+  state.waking = false;
+  m_trace.WriteAction(TraceRecordShutdown, state.server);
+  return true;
+}
+
+bool Monitor::findServers(const std::string& name, std::vector<size_t>& servers, std::ostream& output) const
+{
+  servers.clear();
+  for (size_t index = 0; index < m_servers.size(); ++index)
+  {
+    if (name.empty() || m_registry.GetMachine(m_servers[index].server).GetName() == name)
+      servers.push_back(index);
+  }
+
+  if (servers.empty())
+  {
+    output << "Unknown server " << name << "\n";
+    return false;
+  }
+
+  return true;
+}
+
+bool Monitor::isClientOnline(const ServerState& state) const
+{
+  for (std::vector<MachineId>::const_iterator client = state.clients.begin(); client != state.clients.end(); ++client)
+  {
+    if (m_registry.IsOnline(*client))
+      return true;
+  }
+
+  return false;
+}
+
+bool Monitor::isWanted(const ServerState& state) const
+{
+  switch (state.hold)
+  {
+    case HoldOn:
+      return true;
+
+    case HoldOff:
+      return false;
+
+    case HoldNone:
+    default:
+      break;
+  }
+
+  return m_alwaysOn || isClientOnline(state);
+}
+
+bool Monitor::isChangeNeeded(const ServerState& state) const
+{
+  return isWanted(state) != m_registry.IsOnline(state.server);
+}
+
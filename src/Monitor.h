@@ -0,0 +1,188 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <net/ethernet.h>
+#include <netinet/in.h>
+
+#include <Poco/Timestamp.h>
+
+#include "Backend.h"
+#include "Configuration.h"
+#include "MachineRegistry.h"
+#include "MachineSet.h"
+#include "ProbeScheduler.h"
+#include "Sighting.h"
+#include "StateFile.h"
+#include "Trace.h"
+
+class Metrics;
+struct MachineMetrics;
+struct ServerMetrics;
+class ShutdownExecutor;
+
+// manual override of the automatic decisions for a server
+typedef enum Hold
+{
+  HoldNone = 0,
+  HoldOn,
+  HoldOff
+} Hold;
+
+class Monitor : private PingObserver
+{
+  public:
+    Monitor(const Configuration& config, Backend& backend, Metrics& metrics);
+    ~Monitor();
+
+    // starts the shutdown executors of all servers
+    bool Start();
+    // returns the descriptors which become readable when a shutdown finished
+    void GetShutdownDescriptors(std::vector<int>& descriptors) const;
+
+    // restores the state of the servers and machines from the given file and
+    // keeps it up to date from now on
+    bool OpenStateFile(const std::string& path);
+    // records everything the decisions are based on and the actions taken to
+    // the given trace file
+    bool OpenTrace(const std::string& path);
+
+    // switches over to the given configuration, servers and machines which
+    // haven't changed keep their state
+    void Reload(const Configuration& config);
+
+    const MachineRegistry& GetRegistry() const { return m_registry; }
+    // overrides the state of the server or machine with the given name
+    bool Restore(const std::string& name, bool server, bool online,
+                 const Poco::Timestamp& lastSeen, const Poco::Timestamp& lastChange);
+
+    bool IsAlwaysOn() const { return m_alwaysOn; }
+    void SetAlwaysOn(bool alwaysOn);
+
+    // pings all servers and machines which are due and updates their
+    // availability, optionally pings everything right away
+    void Probe(bool everything = false);
+    // marks the machine with the given MAC or IP address as available
+    void Seen(const Sighting& sighting);
+    // treats the machine with the given MAC or IP address like one which
+    // didn't reply to a ping
+    void Lost(const Sighting& sighting);
+    // re-binds the machine with the MAC address of the sighting to its IP
+    // address and marks it as available
+    void Discovered(const Sighting& sighting);
+    // marks the servers and machines which haven't been seen within their
+    // timeout as unavailable
+    void Expire();
+    // wakes up or shuts down every server if necessary
+    void Decide();
+    // handles the outcome of asynchronous shutdowns of servers
+    void ShutdownFinished();
+
+    // returns the next point in time at which Expire() or Decide() could
+    // change anything
+    bool GetNextDeadline(Poco::Timestamp& deadline) const;
+
+    // manual actions for the server with the given name or all servers if
+    // the name is empty, the outcome is described in the given output
+    bool Wake(const std::string& name, std::ostream& output);
+    bool Shutdown(const std::string& name, std::ostream& output);
+    // a held server is kept on or off until it is released again
+    bool SetHold(const std::string& name, Hold hold, std::ostream& output);
+
+    void WriteStatus(std::ostream& output) const;
+
+  private:
+    Monitor(const Monitor&);
+    Monitor& operator=(const Monitor&);
+
+    typedef struct ServerState
+    {
+      MachineId server;
+      std::vector<MachineId> clients;
+      ShutdownExecutor* shutdownExecutor;
+      Poco::Timestamp lastChange;
+      Hold hold;
+
+      ServerMetrics* metrics;
+      bool waking;
+      Poco::Timestamp wakeStart;
+      Poco::Timestamp shutdownStart;
+    } ServerState;
+
+    typedef struct MachineState
+    {
+      in_addr_t ip;
+      uint8_t mac[ETH_ALEN];
+      bool online;
+      Poco::Timestamp lastSeen;
+    } MachineState;
+
+    void build(std::map<std::string, ServerState>& previousServers);
+    void layoutStateFile();
+    void traceMachines();
+    void publishOnline();
+    void changed(ServerState& state);
+    void update(MachineId id, bool available);
+    void schedule(MachineId id);
+    void prepareEarlyExit();
+    virtual bool Replied(size_t index);
+    void decide(ServerState& state);
+    bool wake(ServerState& state);
+    bool shutdown(ServerState& state);
+    bool findServers(const std::string& name, std::vector<size_t>& servers, std::ostream& output) const;
+    bool isClientOnline(const ServerState& state) const;
+    bool isWanted(const ServerState& state) const;
+    bool isChangeNeeded(const ServerState& state) const;
+
+    // the registry refers to the machines of this copy
+    Configuration m_config;
+    Backend& m_backend;
+    Metrics& m_metrics;
+
+    std::vector<ServerState> m_servers;
+
+    // all servers followed by all machines, every machine is only probed
+    // once no matter how many servers depend on it
+    MachineRegistry m_registry;
+    std::vector<MachineId> m_probes;
+    ProbeScheduler m_scheduler;
+
+    // the indices of the servers which depend on every machine and, during
+    // a probe round which may end early, whether the decision for every
+    // server is already settled
+    std::vector< std::vector<size_t> > m_dependents;
+    std::vector<uint8_t> m_settled;
+    size_t m_unsettled;
+    size_t m_pendingServers;
+    bool m_endedEarly;
+    MachineSet m_available;
+    std::vector<MachineMetrics*> m_machineMetrics;
+
+    StateFile m_stateFile;
+    TraceWriter m_trace;
+
+    bool m_alwaysOn;
+    bool m_started;
+};
+
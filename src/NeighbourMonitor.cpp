@@ -0,0 +1,201 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <log4cxx/logger.h>
+
+#include <errno.h>
+#include <linux/neighbour.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "NeighbourMonitor.h"
+
+#define NEIGHBOUR_BUFFER_SIZE   8192
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("NeighbourMonitor"));
+
+NeighbourMonitor::NeighbourMonitor()
+  : m_interface(),
+    m_interfaceIndex(0),
+    m_netlink(-1),
+    m_sequence(0)
+{ }
+
+NeighbourMonitor::~NeighbourMonitor()
+{
+  Close();
+}
+
+bool NeighbourMonitor::Open(const std::string& interface)
+{
+  Close();
+
+  m_interfaceIndex = static_cast<int>(if_nametoindex(interface.c_str()));
+  if (m_interfaceIndex == 0)
+  {
+    LOG4CXX_ERROR(logger, "Unknown interface " << interface);
+    return false;
+  }
+
+  m_netlink = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (m_netlink < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to open a netlink socket: " << strerror(errno));
+    return false;
+  }
+
+  struct sockaddr_nl address;
+  memset(&address, 0, sizeof(address));
+  address.nl_family = AF_NETLINK;
+  address.nl_groups = RTMGRP_NEIGH;
+  if (bind(m_netlink, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to subscribe to neighbour events: " << strerror(errno));
+    Close();
+    return false;
+  }
+
+  m_interface = interface;
+  if (!requestDump())
+  {
+    Close();
+    return false;
+  }
+
+  LOG4CXX_DEBUG(logger, "Monitoring the neighbour table of " << m_interface);
+  return true;
+}
+
+void NeighbourMonitor::Close()
+{
+  if (m_netlink >= 0)
+    close(m_netlink);
+
+  m_netlink = -1;
+}
+
+void NeighbourMonitor::Process(std::vector<Sighting>& reachable, std::vector<Sighting>& unreachable)
+{
+  if (m_netlink < 0)
+    return;
+
+  char buffer[NEIGHBOUR_BUFFER_SIZE] __attribute__ ((aligned(NLMSG_ALIGNTO)));
+  while (true)
+  {
+    ssize_t length = recv(m_netlink, buffer, sizeof(buffer), 0);
+    if (length < 0)
+    {
+      if (errno == ENOBUFS)
+      {
+        // events have been lost so the whole table has to be read again
+        LOG4CXX_WARN(logger, "Neighbour events on " << m_interface << " have been lost");
+        requestDump();
+        continue;
+      }
+
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        LOG4CXX_WARN(logger, "Failed to receive neighbour events: " << strerror(errno));
+      return;
+    }
+
+    int remaining = static_cast<int>(length);
+    for (const struct nlmsghdr* message = reinterpret_cast<const struct nlmsghdr*>(buffer);
+         NLMSG_OK(message, remaining);
+         message = NLMSG_NEXT(message, remaining))
+    {
+      if (message->nlmsg_type != RTM_NEWNEIGH && message->nlmsg_type != RTM_DELNEIGH)
+        continue;
+
+      const struct ndmsg* neighbour = static_cast<const struct ndmsg*>(NLMSG_DATA(message));
+      if ((neighbour->ndm_family != AF_INET && neighbour->ndm_family != AF_INET6) || neighbour->ndm_ifindex != m_interfaceIndex)
+        continue;
+
+      // IPv6 neighbours (e.g. rotating privacy addresses) are only matched by
+      // their MAC address
+      const bool ipv6 = neighbour->ndm_family == AF_INET6;
+
+      Sighting sighting;
+      memset(&sighting, 0, sizeof(sighting));
+      bool hasDestination = false, hasMac = false;
+
+      int attributesLength = static_cast<int>(RTM_PAYLOAD(message));
+      for (const struct rtattr* attribute = reinterpret_cast<const struct rtattr*>(reinterpret_cast<const char*>(neighbour) + NLMSG_ALIGN(sizeof(struct ndmsg)));
+           RTA_OK(attribute, attributesLength);
+           attribute = RTA_NEXT(attribute, attributesLength))
+      {
+        if (attribute->rta_type == NDA_DST && ipv6)
+          hasDestination = true;
+        else if (attribute->rta_type == NDA_DST && RTA_PAYLOAD(attribute) == sizeof(sighting.ip))
+        {
+          memcpy(&sighting.ip, RTA_DATA(attribute), sizeof(sighting.ip));
+          hasDestination = true;
+        }
+        else if (attribute->rta_type == NDA_LLADDR && RTA_PAYLOAD(attribute) == ETH_ALEN)
+        {
+          memcpy(sighting.mac, RTA_DATA(attribute), ETH_ALEN);
+          hasMac = true;
+        }
+      }
+
+      if (!hasDestination)
+        continue;
+
+      // stale entries are still valid but haven't been confirmed recently so
+      // they neither prove nor disprove a machine's presence
+      // an unreachable IPv6 address (e.g. an expired privacy address) doesn't
+      // say anything about the machine's other addresses
+      if (message->nlmsg_type == RTM_DELNEIGH || (neighbour->ndm_state & (NUD_FAILED | NUD_INCOMPLETE)))
+      {
+        if (!ipv6)
+          unreachable.push_back(sighting);
+      }
+      else if (hasMac && (neighbour->ndm_state & NUD_REACHABLE))
+        reachable.push_back(sighting);
+    }
+  }
+}
+
+bool NeighbourMonitor::requestDump()
+{
+  struct
+  {
+    struct nlmsghdr header;
+    struct ndmsg neighbour;
+  } request;
+
+  memset(&request, 0, sizeof(request));
+  request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+  request.header.nlmsg_type = RTM_GETNEIGH;
+  request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.header.nlmsg_seq = ++m_sequence;
+  request.neighbour.ndm_family = AF_UNSPEC;
+
+  if (send(m_netlink, &request, request.header.nlmsg_len, 0) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to request the neighbour table: " << strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
@@ -0,0 +1,55 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include "Sighting.h"
+
+class NeighbourMonitor
+{
+  public:
+    NeighbourMonitor();
+    ~NeighbourMonitor();
+
+    // subscribes to changes of the kernel's neighbour table for the interface
+    // and requests a dump of its current entries
+    bool Open(const std::string& interface);
+    void Close();
+
+    bool IsOpen() const { return m_netlink >= 0; }
+    int GetDescriptor() const { return m_netlink; }
+
+    // processes all pending neighbour events and appends the neighbours which
+    // have been confirmed as reachable or have failed to resolve
+    void Process(std::vector<Sighting>& reachable, std::vector<Sighting>& unreachable);
+
+  private:
+    NeighbourMonitor(const NeighbourMonitor&);
+    NeighbourMonitor& operator=(const NeighbourMonitor&);
+
+    bool requestDump();
+
+    std::string m_interface;
+    int m_interfaceIndex;
+    int m_netlink;
+    uint32_t m_sequence;
+};
+
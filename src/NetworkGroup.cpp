@@ -0,0 +1,240 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <log4cxx/logger.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "Machine.h"
+#include "MachineRegistry.h"
+#include "NetworkGroup.h"
+#include "Networking.h"
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("NetworkGroup"));
+
+NetworkGroup::Segment::Segment(NetworkGroup& group, Networking* network)
+  : group(group),
+    network(network),
+    machines(),
+    indices(),
+    available(),
+    thread()
+{
+  thread.setName("Ping " + network->GetInterface());
+}
+
+NetworkGroup::Segment::~Segment()
+{
+  delete network;
+}
+
+void NetworkGroup::Segment::run()
+{
+  network->Ping(*group.m_registry, machines, group.m_timeout, available, group.m_observer != NULL ? this : NULL);
+}
+
+bool NetworkGroup::Segment::Replied(size_t index)
+{
+  return group.replied(indices[index]);
+}
+
+NetworkGroup::NetworkGroup()
+  : m_segments(),
+    m_roundTrips(),
+    m_sent(0),
+    m_cancelEvent(-1),
+    m_registry(NULL),
+    m_timeout(0),
+    m_observer(NULL),
+    m_cancelled(false),
+    m_mutex()
+{
+  m_cancelEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_cancelEvent < 0)
+    LOG4CXX_WARN(logger, "Failed to create the cancel event: " << strerror(errno));
+}
+
+NetworkGroup::~NetworkGroup()
+{
+  for (std::vector<Segment*>::iterator segment = m_segments.begin(); segment != m_segments.end(); ++segment)
+    delete *segment;
+  if (m_cancelEvent >= 0)
+    close(m_cancelEvent);
+}
+
+Networking* NetworkGroup::Add(const std::string& interface)
+{
+  Networking* network = new Networking(interface);
+  if (network->GetInterface().empty() ||
+      network->GetIpAddress().empty() ||
+      network->GetMacAddress().empty())
+  {
+    delete network;
+    return NULL;
+  }
+
+  // without the cancel event a round can only end early on the interface
+  // which received the deciding reply
+  if (m_cancelEvent >= 0)
+    network->SetCancelEvent(m_cancelEvent);
+
+  m_segments.push_back(new Segment(*this, network));
+  return network;
+}
+
+void NetworkGroup::SetWakeBurst(unsigned int count, bool udp)
+{
+  for (std::vector<Segment*>::iterator segment = m_segments.begin(); segment != m_segments.end(); ++segment)
+    (*segment)->network->SetWakeBurst(count, udp);
+}
+
+size_t NetworkGroup::Ping(const MachineRegistry& registry, const std::vector<MachineId>& machines, uint8_t timeout,
+                          MachineSet& available, PingObserver* observer)
+{
+  available.Reset(registry.GetSize());
+  m_roundTrips.assign(machines.size(), -1);
+  m_sent = 0;
+  if (machines.empty() || m_segments.empty())
+    return 0;
+
+  for (std::vector<Segment*>::iterator segment = m_segments.begin(); segment != m_segments.end(); ++segment)
+  {
+    (*segment)->machines.clear();
+    (*segment)->indices.clear();
+  }
+  for (size_t index = 0; index < machines.size(); ++index)
+  {
+    Segment& segment = getSegment(registry.GetMachine(machines[index]));
+    segment.machines.push_back(machines[index]);
+    segment.indices.push_back(index);
+  }
+
+  m_registry = &registry;
+  m_timeout = timeout;
+  m_observer = observer;
+  m_cancelled = false;
+
+  // the first interface with machines is pinged on the calling thread and
+  // every other one on its own thread
+  Segment* first = NULL;
+  for (std::vector<Segment*>::iterator segment = m_segments.begin(); segment != m_segments.end(); ++segment)
+  {
+    if ((*segment)->machines.empty())
+      continue;
+
+    if (first == NULL)
+      first = *segment;
+    else
+      (*segment)->thread.start(**segment);
+  }
+
+  first->run();
+  for (std::vector<Segment*>::iterator segment = m_segments.begin(); segment != m_segments.end(); ++segment)
+  {
+    if (*segment != first && !(*segment)->machines.empty())
+      (*segment)->thread.join();
+  }
+
+  // merge the results of all interfaces back into the order of the round
+  for (std::vector<Segment*>::const_iterator segment = m_segments.begin(); segment != m_segments.end(); ++segment)
+  {
+    if ((*segment)->machines.empty())
+      continue;
+
+    m_sent += (*segment)->network->GetSent();
+    const std::vector<Poco::Timestamp::TimeDiff>& roundTrips = (*segment)->network->GetRoundTrips();
+    for (size_t index = 0; index < (*segment)->machines.size(); ++index)
+    {
+      if ((*segment)->available.Test((*segment)->machines[index]))
+        available.Set((*segment)->machines[index]);
+      m_roundTrips[(*segment)->indices[index]] = roundTrips[index];
+    }
+  }
+
+  // the next round mustn't be cancelled right away
+  if (m_cancelled && m_cancelEvent >= 0)
+  {
+    uint64_t value;
+    if (read(m_cancelEvent, &value, sizeof(value)) < 0)
+      LOG4CXX_WARN(logger, "Failed to reset the cancel event: " << strerror(errno));
+  }
+
+  m_registry = NULL;
+  m_observer = NULL;
+  return available.Count();
+}
+
+bool NetworkGroup::Wake(const Machine& machine)
+{
+  if (m_segments.empty())
+    return false;
+
+  return getSegment(machine).network->Wake(machine);
+}
+
+bool NetworkGroup::Shutdown(const Machine& machine, uint16_t connectTimeout, uint16_t executeTimeout)
+{
+  if (m_segments.empty())
+    return false;
+
+  return getSegment(machine).network->Shutdown(machine, connectTimeout, executeTimeout);
+}
+
+ShutdownExecutor* NetworkGroup::CreateShutdownExecutor(uint16_t connectTimeout, uint16_t executeTimeout)
+{
+  // the SSH connections are routed by the kernel no matter which interface
+  // the machine is probed through
+  return m_segments.front()->network->CreateShutdownExecutor(connectTimeout, executeTimeout);
+}
+
+NetworkGroup::Segment& NetworkGroup::getSegment(const Machine& machine) const
+{
+  const std::string& interface = machine.GetInterface();
+  if (!interface.empty())
+  {
+    for (std::vector<Segment*>::const_iterator segment = m_segments.begin() + 1; segment != m_segments.end(); ++segment)
+    {
+      if ((*segment)->network->GetInterface() == interface)
+        return **segment;
+    }
+  }
+
+  return *m_segments.front();
+}
+
+bool NetworkGroup::replied(size_t index)
+{
+  // the observer may wake machines up so it is only ever called by one
+  // interface at a time, waking up doesn't share anything with pinging
+  Poco::FastMutex::ScopedLock lock(m_mutex);
+  if (m_cancelled)
+    return true;
+  if (!m_observer->Replied(index))
+    return false;
+
+  // every other interface stops waiting for replies as well
+  m_cancelled = true;
+  const uint64_t value = 1;
+  if (m_cancelEvent >= 0 && write(m_cancelEvent, &value, sizeof(value)) < 0)
+    LOG4CXX_WARN(logger, "Failed to cancel the round: " << strerror(errno));
+  return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <Poco/Mutex.h>
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
+#include <Poco/Timestamp.h>
+
+#include "Backend.h"
+#include "MachineSet.h"
+
+class Networking;
+
+// probes the machines of several interfaces (e.g. VLANs) through one
+// Networking instance per interface, every interface with machines in a
+// round is pinged on its own thread so that a slow or saturated segment
+// doesn't hold up the others
+class NetworkGroup : public Backend
+{
+  public:
+    NetworkGroup();
+    ~NetworkGroup();
+
+    // the first interface is used for every machine without an interface,
+    // returns NULL if the interface can't be used
+    Networking* Add(const std::string& interface);
+    size_t GetSize() const { return m_segments.size(); }
+    Networking& GetNetworking(size_t index) const { return *m_segments[index]->network; }
+
+    void SetWakeBurst(unsigned int count, bool udp);
+
+    virtual size_t Ping(const MachineRegistry& registry, const std::vector<MachineId>& machines, uint8_t timeout,
+                        MachineSet& available, PingObserver* observer);
+    virtual const std::vector<Poco::Timestamp::TimeDiff>& GetRoundTrips() const { return m_roundTrips; }
+    virtual size_t GetSent() const { return m_sent; }
+
+    virtual bool Wake(const Machine& machine);
+    virtual bool Shutdown(const Machine& machine, uint16_t connectTimeout, uint16_t executeTimeout);
+    virtual ShutdownExecutor* CreateShutdownExecutor(uint16_t connectTimeout, uint16_t executeTimeout);
+
+  private:
+    // the machines of a round which are reached through one interface
+    class Segment : public Poco::Runnable, public PingObserver
+    {
+      public:
+        Segment(NetworkGroup& group, Networking* network);
+        ~Segment();
+
+        virtual void run();
+        virtual bool Replied(size_t index);
+
+        NetworkGroup& group;
+        Networking* network;
+        // the machines and their indices in the round
+        std::vector<MachineId> machines;
+        std::vector<size_t> indices;
+        MachineSet available;
+        Poco::Thread thread;
+
+      private:
+        Segment(const Segment&);
+        Segment& operator=(const Segment&);
+    };
+
+    NetworkGroup(const NetworkGroup&);
+    NetworkGroup& operator=(const NetworkGroup&);
+
+    Segment& getSegment(const Machine& machine) const;
+    bool replied(size_t index);
+
+    std::vector<Segment*> m_segments;
+    std::vector<Poco::Timestamp::TimeDiff> m_roundTrips;
+    size_t m_sent;
+    // shared by all Networking instances to end a round on every interface
+    int m_cancelEvent;
+
+    // only valid during a round, replies of the segments are passed on to
+    // the observer one at a time
+    const MachineRegistry* m_registry;
+    uint8_t m_timeout;
+    PingObserver* m_observer;
+    bool m_cancelled;
+    Poco::FastMutex m_mutex;
+};
@@ -17,257 +17,997 @@
  *
  */
 
+#include <algorithm>
 #include <iostream>
 
 #include <crafter.h>
 
-#include <libssh/libssh.h>
-
 #include <log4cxx/logger.h>
 
-#include <Poco/NumberParser.h>
-#include <Poco/StringTokenizer.h>
+#include <Poco/Timestamp.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/ether.h>
+#include <netinet/icmp6.h>
+#include <netinet/if_ether.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include "Networking.h"
 #include "Machine.h"
+#include "MachineRegistry.h"
+#include "SshSession.h"
+#include "SshShutdownExecutor.h"
+
+#define ICMP_PAYLOAD            "home-monitor"
+#define ICMP_PACKET_SIZE        (sizeof(struct icmphdr) + sizeof(ICMP_PAYLOAD))
+#define ICMP_RECEIVE_SIZE       1500
+
+#ifndef ICMP_FILTER
+#define ICMP_FILTER             1
+#endif
+
+// TCP sockets are tagged with the index of their machine
+#define NETWORKING_TAG_ICMP     UINT64_MAX
+#define NETWORKING_TAG_ARP      (UINT64_MAX - 1)
+#define NETWORKING_TAG_CANCEL   (UINT64_MAX - 2)
+#define NETWORKING_TAG_ICMP6    (UINT64_MAX - 3)
+
+// neighbor discovery packets are sent with and only accepted with this hop
+// limit so that they can't have been routed (RFC 4861)
+#define NDP_HOP_LIMIT           255
+
+#define ETHERTYPE_WAKEONLAN     0x0842
+#define WAKE_UDP_PORT           9
+
+#define SECONDS_TO_MICROSECONDS 1000000
+#define MILLISECONDS_TO_MICROSECONDS 1000
 
 using namespace std;
 
 static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("Networking"));
 
+static uint16_t checksum(const void* data, size_t length)
+{
+  const uint16_t* words = static_cast<const uint16_t*>(data);
+  uint32_t sum = 0;
+  for (; length > 1; length -= 2)
+    sum += *words++;
+  if (length == 1)
+    sum += *reinterpret_cast<const uint8_t*>(words);
+
+  sum = (sum >> 16) + (sum & 0xFFFF);
+  sum += (sum >> 16);
+
+  return static_cast<uint16_t>(~sum);
+}
+
 Networking::Networking(const std::string& interface)
   : m_interface(interface),
     m_ip(),
-    m_mac()
+    m_mac(),
+    m_epoll(-1),
+    m_icmpSocket(-1),
+    m_icmpIdentifier(Crafter::RNG16()),
+    m_icmpSequence(0),
+    m_interfaceIndex(0),
+    m_localIp(INADDR_ANY),
+    m_arpSocket(-1),
+    m_icmp6Socket(-1),
+    m_sent(0),
+    m_observer(NULL),
+    m_wakeSocket(-1),
+    m_udpSocket(-1),
+    m_wakeBurst(1),
+    m_wakeUdp(false)
 {
   m_ip = Crafter::GetMyIP(m_interface);
   m_mac = Crafter::GetMyMAC(m_interface);
+
+  memset(m_localMac, 0, sizeof(m_localMac));
+  struct ether_addr mac;
+  if (ether_aton_r(m_mac.c_str(), &mac) != NULL)
+    memcpy(m_localMac, mac.ether_addr_octet, ETH_ALEN);
+  if (inet_pton(AF_INET, m_ip.c_str(), &m_localIp) != 1)
+    m_localIp = INADDR_ANY;
+  m_interfaceIndex = static_cast<int>(if_nametoindex(m_interface.c_str()));
+
+  m_epoll = epoll_create(1);
+  if (m_epoll < 0)
+    LOG4CXX_ERROR(logger, "Failed to create an epoll instance: " << strerror(errno));
+
+  openIcmpSocket();
+  openIcmp6Socket();
+  openArpSocket();
+  openWakeSockets();
 }
 
-std::vector<Machine> Networking::Ping(const std::vector<Machine>& machines, uint8_t timeout)
+Networking::~Networking()
 {
-  std::vector<Machine> available;
-  if (machines.empty())
-    return available;
+  if (m_icmpSocket >= 0)
+    close(m_icmpSocket);
+  if (m_arpSocket >= 0)
+    close(m_arpSocket);
+  if (m_icmp6Socket >= 0)
+    close(m_icmp6Socket);
+  if (m_wakeSocket >= 0)
+    close(m_wakeSocket);
+  if (m_udpSocket >= 0)
+    close(m_udpSocket);
+  if (m_epoll >= 0)
+    close(m_epoll);
+}
 
-  // prepare an IP header
-  Crafter::IP ipHeader;
-  ipHeader.SetSourceIP(m_ip);
+bool Networking::SetCancelEvent(int descriptor)
+{
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u64 = NETWORKING_TAG_CANCEL;
+  if (m_epoll < 0 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, descriptor, &event) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to watch the cancel event on " << m_interface << ": " << strerror(errno));
+    return false;
+  }
 
-  // prepare an ICMP header
-  Crafter::ICMP icmpHeader;
-  icmpHeader.SetType(Crafter::ICMP::EchoRequest);
-  icmpHeader.SetPayload("home-monitor");
+  return true;
+}
 
-  // go through all machines
-  std::map<std::string, Machine> machineMap;
-  std::vector<Crafter::Packet*> pingPackets;
-  for (std::vector<Machine>::const_iterator machine = machines.begin(); machine != machines.end(); ++machine)
+bool Networking::openIcmpSocket()
+{
+  m_icmpSocket = socket(AF_INET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_ICMP);
+  if (m_icmpSocket < 0)
   {
-    std::string machineIp = machine->GetIpAddress();
-    machineMap.insert(std::make_pair(machineIp, *machine));
+    LOG4CXX_ERROR(logger, "Failed to open a raw ICMP socket: " << strerror(errno));
+    return false;
+  }
 
-    ipHeader.SetDestinationIP(machineIp);
-    icmpHeader.SetIdentifier(Crafter::RNG16());
+  if (setsockopt(m_icmpSocket, SOL_SOCKET, SO_BINDTODEVICE, m_interface.c_str(), m_interface.size()) < 0)
+    LOG4CXX_WARN(logger, "Failed to bind the ICMP socket to " << m_interface << ": " << strerror(errno));
 
-    pingPackets.push_back(new Crafter::Packet(ipHeader / icmpHeader));
-    LOG4CXX_DEBUG(logger, "Preparing to ping " << machine->GetName() << " (" << machineIp << ")...");
+  // only let echo replies through to avoid waking up for unrelated ICMP traffic
+  uint32_t filter = ~(1U << ICMP_ECHOREPLY);
+  if (setsockopt(m_icmpSocket, SOL_RAW, ICMP_FILTER, &filter, sizeof(filter)) < 0)
+    LOG4CXX_DEBUG(logger, "Failed to set the ICMP filter: " << strerror(errno));
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u64 = NETWORKING_TAG_ICMP;
+  if (m_epoll < 0 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_icmpSocket, &event) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to watch the ICMP socket: " << strerror(errno));
+    close(m_icmpSocket);
+    m_icmpSocket = -1;
+    return false;
   }
 
-  // send the ICMP packets and wait for responses
-  std::vector<Crafter::Packet*> pongPackets(pingPackets.size());
-  LOG4CXX_DEBUG(logger, "Pinging " << pingPackets.size() << " machines on " << m_interface << " with a timeout of " << static_cast<uint32_t>(timeout) << " seconds...");
-  Crafter::SendRecv(pingPackets.begin(), pingPackets.end(), pongPackets.begin(), m_interface, timeout, 1, 48);
-  LOG4CXX_DEBUG(logger, "Ping response received for " << pongPackets.size() << " of " << pingPackets.size() << " machines.");
+  return true;
+}
+
+bool Networking::openWakeSockets()
+{
+  if (m_interfaceIndex == 0)
+    return false;
 
-  // go through all the received responses
-  for (std::vector<Crafter::Packet*>::const_iterator pong = pongPackets.begin(); pong != pongPackets.end(); ++pong)
+  m_wakeSocket = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC, htons(ETHERTYPE_WAKEONLAN));
+  if (m_wakeSocket < 0)
+    LOG4CXX_ERROR(logger, "Failed to open a Wake-on-LAN socket: " << strerror(errno));
+
+  m_udpSocket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+  if (m_udpSocket < 0)
+    LOG4CXX_ERROR(logger, "Failed to open a UDP socket: " << strerror(errno));
+  else
   {
-    Crafter::Packet* pongPacket = *pong;
-    if (pongPacket == NULL)
-    {
-      LOG4CXX_TRACE(logger, "Invalid PONG packet received");
-      continue;
-    }
+    int enable = 1;
+    if (setsockopt(m_udpSocket, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable)) < 0 ||
+        setsockopt(m_udpSocket, SOL_SOCKET, SO_BINDTODEVICE, m_interface.c_str(), m_interface.size()) < 0)
+      LOG4CXX_WARN(logger, "Failed to prepare the UDP socket for broadcasts on " << m_interface << ": " << strerror(errno));
+  }
 
-    Crafter::ICMP* icmpLayer = pongPacket->GetLayer<Crafter::ICMP>();
-    if (icmpLayer == NULL || icmpLayer->GetType() != Crafter::ICMP::EchoReply)
-    {
-      LOG4CXX_WARN(logger, "PONG packet not of type ICMP EchoReply received");
+  return m_wakeSocket >= 0;
+}
+
+const Networking::WakePacket& Networking::getWakePacket(const Machine& machine)
+{
+  const uint8_t* mac = machine.GetMac();
+  uint64_t key = 0;
+  for (size_t index = 0; index < ETH_ALEN; ++index)
+    key = (key << 8) | mac[index];
+
+  std::map<uint64_t, WakePacket>::iterator cached = m_wakePackets.find(key);
+  if (cached != m_wakePackets.end())
+    return cached->second;
+
+  // prepare the payload of the ethernet Magic Packet
+  // 6x 0XFF
+  // 16 * 6x MAC address
+  WakePacket packet;
+  memset(packet.payload, 0xFF, ETH_ALEN);
+  for (size_t index = ETH_ALEN; index < sizeof(packet.payload); index += ETH_ALEN)
+    memcpy(packet.payload + index, mac, ETH_ALEN);
+
+  memset(&packet.link, 0, sizeof(packet.link));
+  packet.link.sll_family = AF_PACKET;
+  packet.link.sll_protocol = htons(ETHERTYPE_WAKEONLAN);
+  packet.link.sll_ifindex = m_interfaceIndex;
+  packet.link.sll_halen = ETH_ALEN;
+  memcpy(packet.link.sll_addr, mac, ETH_ALEN);
+
+  return m_wakePackets.insert(std::make_pair(key, packet)).first->second;
+}
+
+bool Networking::openIcmp6Socket()
+{
+  m_icmp6Socket = socket(AF_INET6, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_ICMPV6);
+  if (m_icmp6Socket < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to open a raw ICMPv6 socket: " << strerror(errno));
+    return false;
+  }
+
+  if (setsockopt(m_icmp6Socket, SOL_SOCKET, SO_BINDTODEVICE, m_interface.c_str(), m_interface.size()) < 0)
+    LOG4CXX_WARN(logger, "Failed to bind the ICMPv6 socket to " << m_interface << ": " << strerror(errno));
+
+  // only let echo replies and neighbor advertisements through, the kernel
+  // takes care of the checksums
+  struct icmp6_filter filter;
+  ICMP6_FILTER_SETBLOCKALL(&filter);
+  ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filter);
+  ICMP6_FILTER_SETPASS(ND_NEIGHBOR_ADVERT, &filter);
+  if (setsockopt(m_icmp6Socket, IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter)) < 0)
+    LOG4CXX_DEBUG(logger, "Failed to set the ICMPv6 filter: " << strerror(errno));
+
+  int hops = NDP_HOP_LIMIT;
+  if (setsockopt(m_icmp6Socket, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hops, sizeof(hops)) < 0 ||
+      setsockopt(m_icmp6Socket, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &hops, sizeof(hops)) < 0)
+    LOG4CXX_WARN(logger, "Failed to set the hop limit for neighbor solicitations: " << strerror(errno));
+
+  // the hop limit of received advertisements is passed along with them
+  int enable = 1;
+  if (setsockopt(m_icmp6Socket, IPPROTO_IPV6, IPV6_RECVHOPLIMIT, &enable, sizeof(enable)) < 0)
+    LOG4CXX_WARN(logger, "Failed to receive the hop limit of neighbor advertisements: " << strerror(errno));
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u64 = NETWORKING_TAG_ICMP6;
+  if (m_epoll < 0 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_icmp6Socket, &event) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to watch the ICMPv6 socket: " << strerror(errno));
+    close(m_icmp6Socket);
+    m_icmp6Socket = -1;
+    return false;
+  }
+
+  return true;
+}
+
+bool Networking::openArpSocket()
+{
+  if (m_interfaceIndex == 0)
+  {
+    LOG4CXX_ERROR(logger, "Unknown interface " << m_interface);
+    return false;
+  }
+
+  m_arpSocket = socket(AF_PACKET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, htons(ETH_P_ARP));
+  if (m_arpSocket < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to open an ARP socket: " << strerror(errno));
+    return false;
+  }
+
+  struct sockaddr_ll address;
+  memset(&address, 0, sizeof(address));
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = htons(ETH_P_ARP);
+  address.sll_ifindex = m_interfaceIndex;
+  if (bind(m_arpSocket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to bind the ARP socket to " << m_interface << ": " << strerror(errno));
+    close(m_arpSocket);
+    m_arpSocket = -1;
+    return false;
+  }
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u64 = NETWORKING_TAG_ARP;
+  if (m_epoll < 0 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_arpSocket, &event) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to watch the ARP socket: " << strerror(errno));
+    close(m_arpSocket);
+    m_arpSocket = -1;
+    return false;
+  }
+
+  return true;
+}
+
+size_t Networking::Ping(const MachineRegistry& registry, const std::vector<MachineId>& machines, uint8_t timeout,
+                        MachineSet& available, PingObserver* observer)
+{
+  available.Reset(registry.GetSize());
+  m_sent = 0;
+  if (machines.empty())
+    return 0;
+
+  // every machine pinged over ICMP gets its own sequence number so that the
+  // replies can be routed to the machine they belong to without any lookup
+  const uint16_t firstSequence = m_icmpSequence;
+  m_icmpSequence += static_cast<uint16_t>(machines.size());
+
+  // machines which couldn't be pinged keep the unspecified address so no
+  // reply will ever be matched to them
+  m_destinations.assign(machines.size(), INADDR_ANY);
+  m_arpTargets.clear();
+  m_ndpTargets.clear();
+  m_tcpSockets.assign(machines.size(), -1);
+  m_sendTimes.resize(machines.size());
+  m_roundTrips.assign(machines.size(), -1);
+  m_observer = observer;
+  size_t sent = 0;
+  size_t pending = 0;
+  bool stop = false;
+  // the level is only checked once per round instead of once per machine
+  const bool debug = logger->isDebugEnabled();
+  for (size_t index = 0; index < machines.size(); ++index)
+  {
+    const Machine& machine = registry.GetMachine(machines[index]);
+    const in_addr_t destination = registry.GetIp(machines[index]);
+    const struct in6_addr& destination6 = registry.GetIpv6(machines[index]);
+    const bool ipv6 = machine.GetProbe() == ProbeTypeIcmp6 || machine.GetProbe() == ProbeTypeNdp;
+    if (ipv6 ? IN6_IS_ADDR_UNSPECIFIED(&destination6) : destination == INADDR_ANY)
       continue;
-    }
 
-    Crafter::IP* ipLayer = pongPacket->GetLayer<Crafter::IP>();
-    if (ipLayer == NULL)
+    if (debug)
+      LOG4CXX_DEBUG(logger, "Preparing to ping " << machine.GetName() << " (" << machine.GetIpAddress() << ")...");
+    m_sendTimes[index].update();
+    switch (machine.GetProbe())
     {
-      LOG4CXX_WARN(logger, "PONG packet without an IP layer received");
-      continue;
+      case ProbeTypeArp:
+        if (!sendArp(machine, destination))
+          continue;
+
+        m_arpTargets.push_back(std::make_pair(destination, index));
+        break;
+
+      case ProbeTypeTcp:
+      {
+        // a connection may already be established or refused right away
+        int result = connectTcp(machine, destination, index);
+        if (result < 0)
+          continue;
+        if (result > 0)
+        {
+          // the round isn't cut short before everything has been sent
+          available.Set(machines[index]);
+          m_roundTrips[index] = m_sendTimes[index].elapsed();
+          if (observer != NULL && observer->Replied(index))
+            stop = true;
+          ++sent;
+          continue;
+        }
+        break;
+      }
+
+      case ProbeTypeIcmp6:
+        if (!sendIcmp6(machine, destination6, static_cast<uint16_t>(firstSequence + index)))
+          continue;
+        break;
+
+      case ProbeTypeNdp:
+        if (!sendNdp(machine, destination6))
+          continue;
+
+        m_ndpTargets.push_back(std::make_pair(MachineRegistry::MacToKey(registry.GetMac(machines[index])), index));
+        break;
+
+      case ProbeTypeIcmp:
+      default:
+        if (!sendIcmp(machine, destination, static_cast<uint16_t>(firstSequence + index)))
+          continue;
+        break;
     }
 
-    std::string machineIp = ipLayer->GetSourceIP();
-    if (machineIp.empty())
+    m_destinations[index] = destination;
+    ++sent;
+    ++pending;
+  }
+
+  // ARP replies don't carry anything but the address to match them by
+  std::sort(m_arpTargets.begin(), m_arpTargets.end());
+  std::sort(m_ndpTargets.begin(), m_ndpTargets.end());
+  if (stop)
+    pending = 0;
+
+  // wait for the replies until all of them have arrived or the timeout expired
+  LOG4CXX_DEBUG(logger, "Pinging " << pending << " machines on " << m_interface << " with a timeout of " << static_cast<uint32_t>(timeout) << " seconds...");
+  Poco::Timestamp start;
+  const Poco::Timestamp::TimeDiff maximum = static_cast<Poco::Timestamp::TimeDiff>(timeout) * SECONDS_TO_MICROSECONDS;
+  while (pending > 0)
+  {
+    Poco::Timestamp::TimeDiff remaining = maximum - start.elapsed();
+    if (remaining <= 0)
+      break;
+
+    struct epoll_event events[16];
+    int count = epoll_wait(m_epoll, events, sizeof(events) / sizeof(events[0]),
+                           static_cast<int>((remaining + MILLISECONDS_TO_MICROSECONDS - 1) / MILLISECONDS_TO_MICROSECONDS));
+    if (count < 0)
     {
-      LOG4CXX_WARN(logger, "PONG packet with empty source IP address received");
-      continue;
+      if (errno == EINTR)
+        continue;
+
+      LOG4CXX_ERROR(logger, "Failed to wait for PONG packets: " << strerror(errno));
+      break;
     }
 
-    std::map<std::string, Machine>::const_iterator machine = machineMap.find(machineIp);
-    if (machine == machineMap.end())
+    for (int event = 0; event < count && pending > 0; ++event)
     {
-      LOG4CXX_WARN(logger, "PONG packet for unknown machine at " << machineIp << " received");
-      continue;
+      if (events[event].data.u64 == NETWORKING_TAG_CANCEL)
+      {
+        LOG4CXX_DEBUG(logger, "Pinging on " << m_interface << " has been cancelled");
+        pending = 0;
+      }
+      else if (events[event].data.u64 == NETWORKING_TAG_ICMP)
+        receiveIcmp(registry, machines, firstSequence, available, pending);
+      else if (events[event].data.u64 == NETWORKING_TAG_ARP)
+        receiveArp(registry, machines, available, pending);
+      else if (events[event].data.u64 == NETWORKING_TAG_ICMP6)
+        receiveIcmp6(registry, machines, firstSequence, available, pending);
+      else if (events[event].data.u64 < machines.size())
+        finishTcp(registry, machines, static_cast<size_t>(events[event].data.u64), available, pending);
     }
+  }
 
-    available.push_back(machine->second);
-    LOG4CXX_DEBUG(logger, "PONG packet for " << machine->second.GetName() << " (" << machineIp << ") received");
+  // abort all connection attempts which are still in progress
+  for (std::vector<int>::iterator tcpSocket = m_tcpSockets.begin(); tcpSocket != m_tcpSockets.end(); ++tcpSocket)
+  {
+    if (*tcpSocket >= 0)
+      close(*tcpSocket);
+    *tcpSocket = -1;
   }
 
-  for (std::vector<Crafter::Packet*>::const_iterator ping = pingPackets.begin(); ping != pingPackets.end(); ++ping)
-    delete *ping;
+  m_observer = NULL;
+  m_sent = sent;
+  size_t replies = available.Count();
 
-  for (std::vector<Crafter::Packet*>::const_iterator pong = pongPackets.begin(); pong != pongPackets.end(); ++pong)
-    delete *pong;
+  LOG4CXX_DEBUG(logger, "Ping response received for " << replies << " of " << sent << " machines.");
+  return replies;
+}
 
-  return available;
+bool Networking::sendIcmp(const Machine& machine, in_addr_t destination, uint16_t sequence)
+{
+  if (m_icmpSocket < 0)
+  {
+    LOG4CXX_WARN(logger, "Unable to ping " << machine.GetName() << " without an ICMP socket");
+    return false;
+  }
+
+  uint8_t packet[ICMP_PACKET_SIZE];
+  memset(packet, 0, sizeof(struct icmphdr));
+  memcpy(packet + sizeof(struct icmphdr), ICMP_PAYLOAD, sizeof(ICMP_PAYLOAD));
+
+  struct icmphdr* icmpHeader = reinterpret_cast<struct icmphdr*>(packet);
+  icmpHeader->type = ICMP_ECHO;
+  icmpHeader->un.echo.id = htons(m_icmpIdentifier);
+  icmpHeader->un.echo.sequence = htons(sequence);
+  icmpHeader->checksum = checksum(packet, sizeof(packet));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = destination;
+  if (sendto(m_icmpSocket, packet, sizeof(packet), 0, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0)
+  {
+    LOG4CXX_WARN(logger, "Failed to ping " << machine.GetName() << " (" << machine.GetIpAddress() << "): " << strerror(errno));
+    return false;
+  }
+
+  return true;
 }
 
-bool Networking::Wake(const Machine& machine)
+bool Networking::sendArp(const Machine& machine, in_addr_t destination)
+{
+  if (m_arpSocket < 0)
+  {
+    LOG4CXX_WARN(logger, "Unable to ping " << machine.GetName() << " without an ARP socket");
+    return false;
+  }
+
+  struct ether_arp request;
+  memset(&request, 0, sizeof(request));
+  request.arp_hrd = htons(ARPHRD_ETHER);
+  request.arp_pro = htons(ETHERTYPE_IP);
+  request.arp_hln = ETH_ALEN;
+  request.arp_pln = sizeof(in_addr_t);
+  request.arp_op = htons(ARPOP_REQUEST);
+  memcpy(request.arp_sha, m_localMac, ETH_ALEN);
+  memcpy(request.arp_spa, &m_localIp, sizeof(in_addr_t));
+  memcpy(request.arp_tpa, &destination, sizeof(in_addr_t));
+
+  struct sockaddr_ll address;
+  memset(&address, 0, sizeof(address));
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = htons(ETH_P_ARP);
+  address.sll_ifindex = m_interfaceIndex;
+  address.sll_halen = ETH_ALEN;
+  memset(address.sll_addr, 0xFF, ETH_ALEN);
+  if (sendto(m_arpSocket, &request, sizeof(request), 0, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0)
+  {
+    LOG4CXX_WARN(logger, "Failed to send an ARP request to " << machine.GetName() << " (" << machine.GetIpAddress() << "): " << strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+bool Networking::sendIcmp6(const Machine& machine, const struct in6_addr& destination, uint16_t sequence)
 {
-  const std::string& mac = machine.GetMacAddress();
-  if (mac.empty())
+  if (m_icmp6Socket < 0)
   {
-    LOG4CXX_ERROR(logger, "Invalid MAC address (" << mac << ")");
+    LOG4CXX_WARN(logger, "Unable to ping " << machine.GetName() << " without an ICMPv6 socket");
     return false;
   }
 
-  std::vector<uint8_t> macParts;
-  Poco::StringTokenizer tokenizer(mac, ":", Poco::StringTokenizer::TOK_TRIM);
-  if (tokenizer.count() != 6)
+  uint8_t packet[sizeof(struct icmp6_hdr) + sizeof(ICMP_PAYLOAD)];
+  memset(packet, 0, sizeof(struct icmp6_hdr));
+  memcpy(packet + sizeof(struct icmp6_hdr), ICMP_PAYLOAD, sizeof(ICMP_PAYLOAD));
+
+  struct icmp6_hdr* icmpHeader = reinterpret_cast<struct icmp6_hdr*>(packet);
+  icmpHeader->icmp6_type = ICMP6_ECHO_REQUEST;
+  icmpHeader->icmp6_id = htons(m_icmpIdentifier);
+  icmpHeader->icmp6_seq = htons(sequence);
+
+  // link-local addresses are only valid together with the interface
+  struct sockaddr_in6 address;
+  memset(&address, 0, sizeof(address));
+  address.sin6_family = AF_INET6;
+  address.sin6_addr = destination;
+  address.sin6_scope_id = static_cast<uint32_t>(m_interfaceIndex);
+  if (sendto(m_icmp6Socket, packet, sizeof(packet), 0, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0)
   {
-    LOG4CXX_ERROR(logger, "Invalid MAC address (" << mac << ")");
+    LOG4CXX_WARN(logger, "Failed to ping " << machine.GetName() << " over IPv6: " << strerror(errno));
     return false;
   }
 
-  for (Poco::StringTokenizer::Iterator token = tokenizer.begin(); token != tokenizer.end(); ++token)
+  return true;
+}
+
+bool Networking::sendNdp(const Machine& machine, const struct in6_addr& target)
+{
+  if (m_icmp6Socket < 0)
+  {
+    LOG4CXX_WARN(logger, "Unable to ping " << machine.GetName() << " without an ICMPv6 socket");
+    return false;
+  }
+
+  // the solicitation carries our MAC address so that the machine doesn't
+  // have to resolve it before it can reply
+  uint8_t packet[sizeof(struct nd_neighbor_solicit) + sizeof(struct nd_opt_hdr) + ETH_ALEN];
+  memset(packet, 0, sizeof(packet));
+  struct nd_neighbor_solicit* solicitation = reinterpret_cast<struct nd_neighbor_solicit*>(packet);
+  solicitation->nd_ns_type = ND_NEIGHBOR_SOLICIT;
+  solicitation->nd_ns_target = target;
+  struct nd_opt_hdr* option = reinterpret_cast<struct nd_opt_hdr*>(packet + sizeof(struct nd_neighbor_solicit));
+  option->nd_opt_type = ND_OPT_SOURCE_LINKADDR;
+  option->nd_opt_len = 1;
+  memcpy(packet + sizeof(struct nd_neighbor_solicit) + sizeof(struct nd_opt_hdr), m_localMac, ETH_ALEN);
+
+  // solicitations are sent to the solicited-node multicast address
+  struct sockaddr_in6 address;
+  memset(&address, 0, sizeof(address));
+  address.sin6_family = AF_INET6;
+  address.sin6_addr.s6_addr[0] = 0xFF;
+  address.sin6_addr.s6_addr[1] = 0x02;
+  address.sin6_addr.s6_addr[11] = 0x01;
+  address.sin6_addr.s6_addr[12] = 0xFF;
+  memcpy(&address.sin6_addr.s6_addr[13], &target.s6_addr[13], 3);
+  address.sin6_scope_id = static_cast<uint32_t>(m_interfaceIndex);
+  if (sendto(m_icmp6Socket, packet, sizeof(packet), 0, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0)
+  {
+    LOG4CXX_WARN(logger, "Failed to send a neighbor solicitation to " << machine.GetName() << ": " << strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+int Networking::connectTcp(const Machine& machine, in_addr_t destination, size_t index)
+{
+  int tcpSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+  if (tcpSocket < 0)
+  {
+    LOG4CXX_WARN(logger, "Failed to open a TCP socket for " << machine.GetName() << ": " << strerror(errno));
+    return -1;
+  }
+
+  if (setsockopt(tcpSocket, SOL_SOCKET, SO_BINDTODEVICE, m_interface.c_str(), m_interface.size()) < 0)
+    LOG4CXX_DEBUG(logger, "Failed to bind the TCP socket to " << m_interface << ": " << strerror(errno));
+
+  // reset the connection on close instead of shutting it down gracefully
+  struct linger linger;
+  linger.l_onoff = 1;
+  linger.l_linger = 0;
+  setsockopt(tcpSocket, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = destination;
+  address.sin_port = htons(machine.GetPort());
+  if (connect(tcpSocket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0 || errno == ECONNREFUSED)
+  {
+    LOG4CXX_DEBUG(logger, "TCP port " << machine.GetPort() << " of " << machine.GetName() << " (" << machine.GetIpAddress() << ") answered");
+    close(tcpSocket);
+    return 1;
+  }
+
+  if (errno != EINPROGRESS)
   {
-    try
+    LOG4CXX_WARN(logger, "Failed to connect to " << machine.GetName() << " (" << machine.GetIpAddress() << ":" << machine.GetPort() << "): " << strerror(errno));
+    close(tcpSocket);
+    return -1;
+  }
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLOUT;
+  event.data.u64 = index;
+  if (m_epoll < 0 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, tcpSocket, &event) < 0)
+  {
+    LOG4CXX_WARN(logger, "Failed to watch the TCP socket for " << machine.GetName() << ": " << strerror(errno));
+    close(tcpSocket);
+    return -1;
+  }
+
+  m_tcpSockets[index] = tcpSocket;
+  return 0;
+}
+
+void Networking::finishTcp(const MachineRegistry& registry, const std::vector<MachineId>& machines, size_t index,
+                           MachineSet& available, size_t& pending)
+{
+  int tcpSocket = m_tcpSockets[index];
+  if (tcpSocket < 0)
+    return;
+
+  int error = 0;
+  socklen_t errorLength = sizeof(error);
+  if (getsockopt(tcpSocket, SOL_SOCKET, SO_ERROR, &error, &errorLength) < 0)
+    error = errno;
+
+  close(tcpSocket);
+  m_tcpSockets[index] = -1;
+  --pending;
+
+  // both an accepted (SYN-ACK) and a refused (RST) connection prove that
+  // the host is up
+  const Machine& machine = registry.GetMachine(machines[index]);
+  if (error == 0 || error == ECONNREFUSED)
+  {
+    replied(machines, index, available, pending);
+    LOG4CXX_DEBUG(logger, "TCP port " << machine.GetPort() << " of " << machine.GetName() << " (" << machine.GetIpAddress() << ") answered");
+  }
+  else
+    LOG4CXX_DEBUG(logger, "Connecting to " << machine.GetName() << " (" << machine.GetIpAddress() << ":" << machine.GetPort() << ") failed: " << strerror(error));
+}
+
+void Networking::replied(const std::vector<MachineId>& machines, size_t index, MachineSet& available, size_t& pending)
+{
+  available.Set(machines[index]);
+  m_roundTrips[index] = m_sendTimes[index].elapsed();
+
+  // nothing is waited for anymore once there are no pending replies
+  if (m_observer != NULL && m_observer->Replied(index))
+    pending = 0;
+}
+
+void Networking::receiveIcmp(const MachineRegistry& registry, const std::vector<MachineId>& machines,
+                             uint16_t firstSequence, MachineSet& available, size_t& pending)
+{
+  uint8_t buffer[ICMP_RECEIVE_SIZE];
+  const bool debug = logger->isDebugEnabled();
+  while (pending > 0)
+  {
+    ssize_t length = recv(m_icmpSocket, buffer, sizeof(buffer), 0);
+    if (length < 0)
     {
-      unsigned int tok = Poco::NumberParser::parseHex(*token);
-      if (tok > 255)
-      {
-        LOG4CXX_ERROR(logger, "Invalid MAC address (" << mac << ")");
-        return false;
-      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        LOG4CXX_WARN(logger, "Failed to receive a PONG packet: " << strerror(errno));
+      return;
+    }
 
-      macParts.push_back(static_cast<uint8_t>(tok));
+    // raw ICMP sockets deliver the packet including its IP header
+    const struct iphdr* ipHeader = reinterpret_cast<const struct iphdr*>(buffer);
+    size_t ipHeaderLength = static_cast<size_t>(ipHeader->ihl) * 4;
+    if (static_cast<size_t>(length) < sizeof(struct iphdr) ||
+        static_cast<size_t>(length) < ipHeaderLength + sizeof(struct icmphdr))
+    {
+      LOG4CXX_TRACE(logger, "Invalid PONG packet received");
+      continue;
     }
-    catch (Poco::SyntaxException &e)
+
+    const struct icmphdr* icmpHeader = reinterpret_cast<const struct icmphdr*>(buffer + ipHeaderLength);
+    if (icmpHeader->type != ICMP_ECHOREPLY || ntohs(icmpHeader->un.echo.id) != m_icmpIdentifier)
+      continue;
+
+    uint16_t index = static_cast<uint16_t>(ntohs(icmpHeader->un.echo.sequence) - firstSequence);
+    if (index >= machines.size() || available.Test(machines[index]))
+      continue;
+
+    const Machine& machine = registry.GetMachine(machines[index]);
+    if (machine.GetProbe() != ProbeTypeIcmp)
+      continue;
+
+    if (m_destinations[index] == INADDR_ANY || m_destinations[index] != ipHeader->saddr)
     {
-      LOG4CXX_ERROR(logger, "Invalid MAC address (" << mac << ")");
-      return false;
+      struct in_addr source;
+      source.s_addr = ipHeader->saddr;
+      LOG4CXX_WARN(logger, "PONG packet for " << machine.GetName() << " received from unexpected address " << inet_ntoa(source));
+      continue;
     }
+
+    --pending;
+    replied(machines, index, available, pending);
+    if (debug)
+      LOG4CXX_DEBUG(logger, "PONG packet for " << machine.GetName() << " (" << machine.GetIpAddress() << ") received");
   }
+}
 
-  // prepare the payload of the ethernet Magic PAcket
-  // 6x 0XFF
-  // 16 * 6x MAC address
-  uint8_t payload[102];
-  memset(payload, 0xFF, 6);
-  size_t index = 6;
-  for (int num = 0; num < 16; ++num)
+void Networking::receiveArp(const MachineRegistry& registry, const std::vector<MachineId>& machines,
+                            MachineSet& available, size_t& pending)
+{
+  struct ether_arp reply;
+  const bool debug = logger->isDebugEnabled();
+  while (pending > 0)
   {
-    for (std::vector<uint8_t>::const_iterator it = macParts.begin(); it != macParts.end(); ++it)
+    ssize_t length = recv(m_arpSocket, &reply, sizeof(reply), 0);
+    if (length < 0)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        LOG4CXX_WARN(logger, "Failed to receive an ARP reply: " << strerror(errno));
+      return;
+    }
+
+    if (static_cast<size_t>(length) < sizeof(reply) || ntohs(reply.arp_op) != ARPOP_REPLY ||
+        ntohs(reply.arp_pro) != ETHERTYPE_IP || memcmp(reply.arp_tpa, &m_localIp, sizeof(in_addr_t)) != 0)
+      continue;
+
+    in_addr_t source;
+    memcpy(&source, reply.arp_spa, sizeof(source));
+
+    std::vector< std::pair<in_addr_t, size_t> >::const_iterator target =
+      std::lower_bound(m_arpTargets.begin(), m_arpTargets.end(), std::make_pair(source, static_cast<size_t>(0)));
+    for (; target != m_arpTargets.end() && target->first == source && pending > 0; ++target)
     {
-      payload[index] = *it;
-      ++index;
+      const MachineId id = machines[target->second];
+      if (available.Test(id))
+        continue;
+
+      --pending;
+      replied(machines, target->second, available, pending);
+      if (debug)
+        LOG4CXX_DEBUG(logger, "ARP reply for " << registry.GetMachine(id).GetName() << " (" << registry.GetMachine(id).GetIpAddress() << ") received");
     }
   }
+}
+
+void Networking::receiveIcmp6(const MachineRegistry& registry, const std::vector<MachineId>& machines,
+                              uint16_t firstSequence, MachineSet& available, size_t& pending)
+{
+  uint8_t buffer[ICMP_RECEIVE_SIZE] __attribute__ ((aligned(8)));
+  uint8_t control[CMSG_SPACE(sizeof(int))] __attribute__ ((aligned(8)));
+  const bool debug = logger->isDebugEnabled();
+  while (pending > 0)
+  {
+    // raw ICMPv6 sockets deliver the packet without its IP header, its hop
+    // limit comes as ancillary data
+    struct iovec vector;
+    vector.iov_base = buffer;
+    vector.iov_len = sizeof(buffer);
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t length = recvmsg(m_icmp6Socket, &message, 0);
+    if (length < 0)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        LOG4CXX_WARN(logger, "Failed to receive an ICMPv6 packet: " << strerror(errno));
+      return;
+    }
+
+    if (static_cast<size_t>(length) < sizeof(struct icmp6_hdr))
+    {
+      LOG4CXX_TRACE(logger, "Invalid ICMPv6 packet received");
+      continue;
+    }
 
-  Crafter::Ethernet ether;
-  ether.SetSourceMAC(m_mac);
-  ether.SetDestinationMAC(mac);
-  ether.SetPayload(payload, sizeof(payload));
+    const struct icmp6_hdr* icmpHeader = reinterpret_cast<const struct icmp6_hdr*>(buffer);
+    if (icmpHeader->icmp6_type == ND_NEIGHBOR_ADVERT)
+    {
+      // the hop limit is only unknown if the kernel couldn't be asked for it
+      int hops = -1;
+      for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header != NULL; header = CMSG_NXTHDR(&message, header))
+      {
+        if (header->cmsg_level == IPPROTO_IPV6 && header->cmsg_type == IPV6_HOPLIMIT)
+          memcpy(&hops, CMSG_DATA(header), sizeof(hops));
+      }
 
-  Crafter::Packet packet = ether;
+      if (hops >= 0 && hops != NDP_HOP_LIMIT)
+      {
+        LOG4CXX_TRACE(logger, "Routed neighbor advertisement with a hop limit of " << hops << " dropped");
+        continue;
+      }
 
-  LOG4CXX_DEBUG(logger, "Sending Wake-on-LAN magic packet to " << mac << "...");
-  return packet.Send(m_interface) > 0;
+      receiveNdp(registry, machines, buffer, static_cast<size_t>(length), available, pending);
+      continue;
+    }
+
+    // privacy addresses may answer instead of the pinged one so only the
+    // sequence number identifies the machine
+    if (icmpHeader->icmp6_type != ICMP6_ECHO_REPLY || ntohs(icmpHeader->icmp6_id) != m_icmpIdentifier)
+      continue;
+
+    uint16_t index = static_cast<uint16_t>(ntohs(icmpHeader->icmp6_seq) - firstSequence);
+    if (index >= machines.size() || available.Test(machines[index]))
+      continue;
+
+    const Machine& machine = registry.GetMachine(machines[index]);
+    if (machine.GetProbe() != ProbeTypeIcmp6)
+      continue;
+
+    --pending;
+    replied(machines, index, available, pending);
+    if (debug)
+      LOG4CXX_DEBUG(logger, "ICMPv6 PONG packet for " << machine.GetName() << " received");
+  }
 }
 
-bool Networking::Shutdown(const Machine& machine)
+void Networking::receiveNdp(const MachineRegistry& registry, const std::vector<MachineId>& machines,
+                            const uint8_t* advertisement, size_t length, MachineSet& available, size_t& pending)
 {
-  const std::string& ip = machine.GetIpAddress();
-  const std::string& username = machine.GetUsername();
-  const std::string& password = machine.GetPassword();
-  if (ip.empty() || username.empty())
+  if (length < sizeof(struct nd_neighbor_advert) || m_ndpTargets.empty())
+    return;
+
+  // the target link-layer address option identifies the machine no matter
+  // which of its addresses it has been solicited for
+  uint64_t mac = 0;
+  for (size_t offset = sizeof(struct nd_neighbor_advert); offset + sizeof(struct nd_opt_hdr) + ETH_ALEN <= length; )
   {
-    LOG4CXX_ERROR(logger, "Missing IP address (" << ip << ") or username (" << username << ")");
-    return false;
+    const struct nd_opt_hdr* option = reinterpret_cast<const struct nd_opt_hdr*>(advertisement + offset);
+    if (option->nd_opt_len == 0)
+      break;
+
+    if (option->nd_opt_type == ND_OPT_TARGET_LINKADDR)
+    {
+      mac = MachineRegistry::MacToKey(advertisement + offset + sizeof(struct nd_opt_hdr));
+      break;
+    }
+    offset += static_cast<size_t>(option->nd_opt_len) * 8;
   }
 
-  ssh_session ssh;
-  ssh_channel channel;
-  
-  ssh = ssh_new();
-  if (ssh == NULL)
+  const struct in6_addr& target = reinterpret_cast<const struct nd_neighbor_advert*>(advertisement)->nd_na_target;
+  const bool debug = logger->isDebugEnabled();
+  std::vector< std::pair<uint64_t, size_t> >::const_iterator entry = m_ndpTargets.begin();
+  if (mac != 0)
+    entry = std::lower_bound(m_ndpTargets.begin(), m_ndpTargets.end(), std::make_pair(mac, static_cast<size_t>(0)));
+  for (; entry != m_ndpTargets.end() && pending > 0; ++entry)
   {
-    LOG4CXX_ERROR(logger, "libssh error (ssh_new)");
-    return false;
+    if (mac != 0 && entry->first != mac)
+      break;
+
+    const MachineId id = machines[entry->second];
+    if ((mac == 0 && !IN6_ARE_ADDR_EQUAL(&registry.GetIpv6(id), &target)) || available.Test(id))
+      continue;
+
+    --pending;
+    replied(machines, entry->second, available, pending);
+    if (debug)
+      LOG4CXX_DEBUG(logger, "Neighbor advertisement for " << registry.GetMachine(id).GetName() << " received");
   }
+}
 
-  // set the remote host and the user to be used
-  ssh_options_set(ssh, SSH_OPTIONS_HOST, ip.c_str());
-  ssh_options_set(ssh, SSH_OPTIONS_USER, username.c_str());
+void Networking::SetWakeBurst(unsigned int count, bool udp)
+{
+  if (count == 0)
+    count = 1;
+  else if (count > WAKE_MAX_BURST)
+    count = WAKE_MAX_BURST;
+
+  m_wakeBurst = count;
+  m_wakeUdp = udp;
+}
 
-  LOG4CXX_DEBUG(logger, "Connecting to " << machine.GetName() << " at " << ip << " as " << username << " over SSH...");
-  int rc = ssh_connect(ssh);
-  if (rc != SSH_OK)
+bool Networking::Wake(const Machine& machine)
+{
+  if (m_wakeSocket < 0 && (!m_wakeUdp || m_udpSocket < 0))
   {
-    LOG4CXX_ERROR(logger, "Unable to connect to " << machine.GetName() << " at " << ip << " as " << username << " (" << rc << ")");
-    goto session_free;
+    LOG4CXX_ERROR(logger, "Unable to send Wake-on-LAN magic packets to " << machine.GetMacAddress());
+    return false;
   }
 
-  if (!password.empty())
+  const WakePacket& packet = getWakePacket(machine);
+
+  // every message of the burst points at the same cached packet
+  struct iovec payload;
+  payload.iov_base = const_cast<uint8_t*>(packet.payload);
+  payload.iov_len = sizeof(packet.payload);
+
+  struct sockaddr_in broadcast;
+  memset(&broadcast, 0, sizeof(broadcast));
+  broadcast.sin_family = AF_INET;
+  broadcast.sin_port = htons(WAKE_UDP_PORT);
+  broadcast.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+
+  struct mmsghdr linkMessages[WAKE_MAX_BURST];
+  struct mmsghdr udpMessages[WAKE_MAX_BURST];
+  memset(linkMessages, 0, sizeof(linkMessages));
+  memset(udpMessages, 0, sizeof(udpMessages));
+  for (unsigned int index = 0; index < m_wakeBurst; ++index)
   {
-    LOG4CXX_DEBUG(logger, "Authenticating as " << username << "on " << machine.GetName() << " at " << ip << " over SSH...");
-    rc = ssh_userauth_password(ssh, NULL, password.c_str());
-    if (rc != SSH_AUTH_SUCCESS)
-    {
-      LOG4CXX_ERROR(logger, "Authentication as " << username << " failed on " << machine.GetName() << " at " << ip << " (" << rc << ")");
-      goto session_disconnect;
-    }
+    linkMessages[index].msg_hdr.msg_name = const_cast<struct sockaddr_ll*>(&packet.link);
+    linkMessages[index].msg_hdr.msg_namelen = sizeof(packet.link);
+    linkMessages[index].msg_hdr.msg_iov = &payload;
+    linkMessages[index].msg_hdr.msg_iovlen = 1;
+
+    udpMessages[index].msg_hdr.msg_name = &broadcast;
+    udpMessages[index].msg_hdr.msg_namelen = sizeof(broadcast);
+    udpMessages[index].msg_hdr.msg_iov = &payload;
+    udpMessages[index].msg_hdr.msg_iovlen = 1;
   }
 
-  channel = ssh_channel_new(ssh);
-  if (channel == NULL)
+  LOG4CXX_DEBUG(logger, "Sending " << m_wakeBurst << " Wake-on-LAN magic packet(s) to " << machine.GetMacAddress() << "...");
+  int sent = 0;
+  if (m_wakeSocket >= 0)
   {
-    LOG4CXX_ERROR(logger, "libssh error (ssh_channel_new)");
-    goto session_disconnect;
+    int rc = sendmmsg(m_wakeSocket, linkMessages, m_wakeBurst, 0);
+    if (rc < 0)
+      LOG4CXX_WARN(logger, "Failed to send Wake-on-LAN magic packets to " << machine.GetMacAddress() << ": " << strerror(errno));
+    else
+      sent += rc;
   }
 
-  rc = ssh_channel_open_session(channel);
-  if (rc != SSH_OK)
+  if (m_wakeUdp && m_udpSocket >= 0)
   {
-    LOG4CXX_ERROR(logger, "Unable to open a new SSH channel on " << machine.GetName() << " at " << ip << " (" << rc << ")");
-    goto channel_free;
+    int rc = sendmmsg(m_udpSocket, udpMessages, m_wakeBurst, 0);
+    if (rc < 0)
+      LOG4CXX_WARN(logger, "Failed to broadcast Wake-on-LAN magic packets for " << machine.GetMacAddress() << ": " << strerror(errno));
+    else
+      sent += rc;
   }
 
-  LOG4CXX_DEBUG(logger, "Executing 'shutdown -h now' on " << machine.GetName() << " at " << ip << " as " << username << "...");
-  rc = ssh_channel_request_exec(channel, "shutdown -h now");
-  if (rc != SSH_OK)
-    LOG4CXX_ERROR(logger, "Failed to execute 'shutdown -h now' on " << machine.GetName() << " at " << ip << " as " << username << " (" << rc << ")");
-
-  channel_close(channel);
+  return sent > 0;
+}
 
-channel_free:
-  ssh_channel_free(channel);
-  
-session_disconnect:
-  ssh_disconnect(ssh);
+bool Networking::Shutdown(const Machine& machine, uint16_t connectTimeout, uint16_t executeTimeout)
+{
+  SshSession session;
+  if (!session.Connect(machine.GetIpAddress(), machine.GetUsername(), machine.GetPassword(), connectTimeout))
+    return false;
 
-session_free:
-  ssh_free(ssh);
+  return session.Execute("shutdown -h now", executeTimeout);
+}
 
-  return rc == SSH_OK;
+ShutdownExecutor* Networking::CreateShutdownExecutor(uint16_t connectTimeout, uint16_t executeTimeout)
+{
+  return new SshShutdownExecutor(connectTimeout, executeTimeout);
 }
 
@@ -18,28 +18,121 @@
  *
  */
 
+#include <map>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
 #include <stdint.h>
 
+#include <Poco/Timestamp.h>
+
+#include "Backend.h"
+#include "MachineSet.h"
+
+#define WAKE_MAX_BURST          16
+
 class Machine;
+class MachineRegistry;
 
-class Networking
+class Networking : public Backend
 {
   public:
     Networking(const std::string& interface);
+    ~Networking();
 
     const std::string& GetInterface() const { return m_interface; }
     const std::string& GetIpAddress() const { return m_ip; }
     const std::string& GetMacAddress() const {return m_mac; }
 
-    std::vector<Machine> Ping(const std::vector<Machine>& machines, uint8_t timeout);
+    // pings all given machines at once and marks the ones which replied
+    // within the timeout as available, returns the number of replies
+    virtual size_t Ping(const MachineRegistry& registry, const std::vector<MachineId>& machines, uint8_t timeout,
+                        MachineSet& available, PingObserver* observer);
+    virtual const std::vector<Poco::Timestamp::TimeDiff>& GetRoundTrips() const { return m_roundTrips; }
+    virtual size_t GetSent() const { return m_sent; }
+    // Ping() stops waiting for replies while the descriptor (e.g. an eventfd
+    // shared by several instances) is readable, it isn't owned or read
+    bool SetCancelEvent(int descriptor);
 
-    bool Wake(const Machine& machine);
-    bool Shutdown(const Machine& machine);
+    // sends every Wake-on-LAN magic packet count times in a single burst,
+    // optionally also as a UDP broadcast to port 9
+    void SetWakeBurst(unsigned int count, bool udp);
+    virtual bool Wake(const Machine& machine);
+    virtual bool Shutdown(const Machine& machine, uint16_t connectTimeout, uint16_t executeTimeout);
+    virtual ShutdownExecutor* CreateShutdownExecutor(uint16_t connectTimeout, uint16_t executeTimeout);
 
   private:
+    // 6x 0xFF followed by 16x the MAC address
+    struct WakePacket
+    {
+      uint8_t payload[ETH_ALEN + 16 * ETH_ALEN];
+      struct sockaddr_ll link;
+    };
+
+    Networking(const Networking&);
+    Networking& operator=(const Networking&);
+
+    bool openIcmpSocket();
+    bool openIcmp6Socket();
+    bool openArpSocket();
+    bool openWakeSockets();
+
+    const WakePacket& getWakePacket(const Machine& machine);
+
+    bool sendIcmp(const Machine& machine, in_addr_t destination, uint16_t sequence);
+    bool sendArp(const Machine& machine, in_addr_t destination);
+    bool sendIcmp6(const Machine& machine, const struct in6_addr& destination, uint16_t sequence);
+    bool sendNdp(const Machine& machine, const struct in6_addr& target);
+    // returns 1 if the connection has been established or refused right
+    // away, 0 if it is in progress and -1 on failure
+    int connectTcp(const Machine& machine, in_addr_t destination, size_t index);
+    // records the reply of the machine at the given index and ends the round
+    // if the observer doesn't need any more replies
+    void replied(const std::vector<MachineId>& machines, size_t index, MachineSet& available, size_t& pending);
+
+    void receiveIcmp(const MachineRegistry& registry, const std::vector<MachineId>& machines,
+                     uint16_t firstSequence, MachineSet& available, size_t& pending);
+    void receiveArp(const MachineRegistry& registry, const std::vector<MachineId>& machines,
+                    MachineSet& available, size_t& pending);
+    void receiveIcmp6(const MachineRegistry& registry, const std::vector<MachineId>& machines,
+                      uint16_t firstSequence, MachineSet& available, size_t& pending);
+    void receiveNdp(const MachineRegistry& registry, const std::vector<MachineId>& machines,
+                    const uint8_t* advertisement, size_t length, MachineSet& available, size_t& pending);
+    void finishTcp(const MachineRegistry& registry, const std::vector<MachineId>& machines, size_t index,
+                   MachineSet& available, size_t& pending);
+
     std::string m_interface;
     std::string m_ip;
     std::string m_mac;
+
+    int m_epoll;
+    int m_icmpSocket;
+    uint16_t m_icmpIdentifier;
+    uint16_t m_icmpSequence;
+    std::vector<in_addr_t> m_destinations;
+
+    int m_interfaceIndex;
+    uint8_t m_localMac[ETH_ALEN];
+    in_addr_t m_localIp;
+    int m_arpSocket;
+    std::vector< std::pair<in_addr_t, size_t> > m_arpTargets;
+    int m_icmp6Socket;
+    // neighbor advertisements are matched by the MAC address of the machine
+    std::vector< std::pair<uint64_t, size_t> > m_ndpTargets;
+    std::vector<int> m_tcpSockets;
+    std::vector<Poco::Timestamp> m_sendTimes;
+    std::vector<Poco::Timestamp::TimeDiff> m_roundTrips;
+    size_t m_sent;
+    PingObserver* m_observer;
+
+    int m_wakeSocket;
+    int m_udpSocket;
+    unsigned int m_wakeBurst;
+    bool m_wakeUdp;
+    std::map<uint64_t, WakePacket> m_wakePackets;
 };
 
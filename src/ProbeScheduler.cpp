@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <functional>
+
+#include "ProbeScheduler.h"
+
+// the heap is rebuilt once stale entries make up most of it
+#define PROBE_HEAP_SLACK        2
+
+ProbeScheduler::ProbeScheduler()
+  : m_due(),
+    m_heap()
+{ }
+
+void ProbeScheduler::Reset(size_t count, const Poco::Timestamp& due)
+{
+  m_due.assign(count, due.epochMicroseconds());
+  m_heap.clear();
+  m_heap.reserve(count * PROBE_HEAP_SLACK + 1);
+
+  // all entries are equal so they already form a heap
+  for (MachineId id = 0; id < count; ++id)
+    m_heap.push_back(Entry(due.epochMicroseconds(), id));
+}
+
+void ProbeScheduler::Schedule(MachineId id, const Poco::Timestamp& due)
+{
+  // the previous entry of the machine stays in the heap until it surfaces
+  m_due[id] = due.epochMicroseconds();
+  m_heap.push_back(Entry(m_due[id], id));
+  std::push_heap(m_heap.begin(), m_heap.end(), std::greater<Entry>());
+
+  if (m_heap.size() > m_due.size() * PROBE_HEAP_SLACK)
+    compact();
+}
+
+void ProbeScheduler::TakeDue(const Poco::Timestamp& until, std::vector<MachineId>& machines)
+{
+  const Poco::Timestamp::TimeVal limit = until.epochMicroseconds();
+  for (skipStale(); !m_heap.empty() && m_heap.front().first <= limit; skipStale())
+  {
+    const MachineId id = m_heap.front().second;
+    std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<Entry>());
+    m_heap.pop_back();
+
+    m_due[id] = UNSCHEDULED;
+    machines.push_back(id);
+  }
+}
+
+bool ProbeScheduler::GetNext(Poco::Timestamp& next)
+{
+  skipStale();
+  if (m_heap.empty())
+    return false;
+
+  next = Poco::Timestamp(m_heap.front().first);
+  return true;
+}
+
+void ProbeScheduler::skipStale()
+{
+  while (!m_heap.empty() && m_heap.front().first != m_due[m_heap.front().second])
+  {
+    std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<Entry>());
+    m_heap.pop_back();
+  }
+}
+
+void ProbeScheduler::compact()
+{
+  std::vector<Entry>::iterator end = m_heap.begin();
+  for (std::vector<Entry>::const_iterator entry = m_heap.begin(); entry != m_heap.end(); ++entry)
+  {
+    if (entry->first == m_due[entry->second])
+      *end++ = *entry;
+  }
+  m_heap.erase(end, m_heap.end());
+  std::make_heap(m_heap.begin(), m_heap.end(), std::greater<Entry>());
+}
@@ -0,0 +1,66 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <utility>
+#include <vector>
+
+#include <Poco/Timestamp.h>
+
+#include "MachineSet.h"
+
+// keeps the point in time at which every machine needs to be probed next in
+// a min-heap so that a probe round only has to look at the machines which
+// are due, every machine is due at most once at a time
+class ProbeScheduler
+{
+  public:
+    ProbeScheduler();
+
+    // makes every one of the given number of machines due at the given time
+    void Reset(size_t count, const Poco::Timestamp& due);
+
+    // replaces the point in time at which the machine is due
+    void Schedule(MachineId id, const Poco::Timestamp& due);
+    bool IsScheduled(MachineId id) const { return m_due[id] != UNSCHEDULED; }
+
+    // removes all machines which are due until the given time and adds them
+    // to the given ones, they need to be scheduled again afterwards
+    void TakeDue(const Poco::Timestamp& until, std::vector<MachineId>& machines);
+
+    // returns when the next machine is due
+    bool GetNext(Poco::Timestamp& next);
+
+  private:
+    typedef std::pair<Poco::Timestamp::TimeVal, MachineId> Entry;
+
+    static const Poco::Timestamp::TimeVal UNSCHEDULED = -1;
+
+    ProbeScheduler(const ProbeScheduler&);
+    ProbeScheduler& operator=(const ProbeScheduler&);
+
+    // drops entries which have been replaced by a later Schedule()
+    void skipStale();
+    void compact();
+
+    std::vector<Poco::Timestamp::TimeVal> m_due;
+    // ordered by std::greater so that the earliest entry is at the front
+    std::vector<Entry> m_heap;
+};
+
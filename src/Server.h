@@ -0,0 +1,46 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <vector>
+
+#include "Machine.h"
+
+class Server
+{
+  public:
+    Server()
+    { }
+    Server(const Machine& machine, const std::vector<size_t>& clients)
+      : m_machine(machine),
+        m_clients(clients)
+    { }
+
+    Machine& GetMachine() { return m_machine; }
+    const Machine& GetMachine() const { return m_machine; }
+
+    // indices into Configuration::GetMachines() of the machines which need
+    // the server
+    const std::vector<size_t>& GetClients() const { return m_clients; }
+
+  private:
+    Machine m_machine;
+    std::vector<size_t> m_clients;
+};
+
@@ -0,0 +1,48 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+class Machine;
+
+// shuts machines down asynchronously, one at a time
+class ShutdownExecutor
+{
+  public:
+    virtual ~ShutdownExecutor() { }
+
+    virtual bool Start() = 0;
+    virtual void Stop() = 0;
+
+    // becomes readable whenever a shutdown has finished, -1 if the outcome
+    // is available right away
+    virtual int GetDescriptor() const = 0;
+
+    // tells the executor whether the machine is online so that it can
+    // prepare shutting it down
+    virtual void SetOnline(const Machine& machine, bool online) = 0;
+
+    // asynchronously shuts the machine down, returns false if a shutdown is
+    // still in progress
+    virtual bool Shutdown(const Machine& machine) = 0;
+    virtual bool IsBusy() const = 0;
+
+    // retrieves the outcome of a finished shutdown
+    virtual bool GetResult(bool& success) = 0;
+};
+
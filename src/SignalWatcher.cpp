@@ -0,0 +1,75 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <log4cxx/logger.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include "SignalWatcher.h"
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("SignalWatcher"));
+
+SignalWatcher::SignalWatcher()
+  : m_signal(-1)
+{
+  sigemptyset(&m_signals);
+  m_signal = signalfd(-1, &m_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (m_signal < 0)
+    LOG4CXX_ERROR(logger, "Failed to create a signal descriptor: " << strerror(errno));
+}
+
+SignalWatcher::~SignalWatcher()
+{
+  if (m_signal >= 0)
+    close(m_signal);
+
+  sigprocmask(SIG_UNBLOCK, &m_signals, NULL);
+}
+
+bool SignalWatcher::Add(int signal)
+{
+  if (m_signal < 0)
+    return false;
+
+  sigaddset(&m_signals, signal);
+  if (sigprocmask(SIG_BLOCK, &m_signals, NULL) < 0 ||
+      signalfd(m_signal, &m_signals, 0) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to watch signal " << signal << ": " << strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+int SignalWatcher::Read()
+{
+  if (m_signal < 0)
+    return 0;
+
+  struct signalfd_siginfo info;
+  if (read(m_signal, &info, sizeof(info)) != sizeof(info))
+    return 0;
+
+  return static_cast<int>(info.ssi_signo);
+}
+
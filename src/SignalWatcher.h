@@ -0,0 +1,45 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <signal.h>
+
+class SignalWatcher
+{
+  public:
+    SignalWatcher();
+    ~SignalWatcher();
+
+    int GetDescriptor() const { return m_signal; }
+
+    // blocks the given signal for normal delivery and reports it through the
+    // descriptor instead
+    bool Add(int signal);
+
+    // returns the number of the next pending signal or 0 if there is none
+    int Read();
+
+  private:
+    SignalWatcher(const SignalWatcher&);
+    SignalWatcher& operator=(const SignalWatcher&);
+
+    int m_signal;
+    sigset_t m_signals;
+};
+
@@ -0,0 +1,234 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+
+#include "Clock.h"
+#include "Machine.h"
+#include "MachineRegistry.h"
+#include "ShutdownExecutor.h"
+#include "SimulatedBackend.h"
+
+#define SECONDS_TO_MICROSECONDS 1000000
+
+#define NO_HOST                 static_cast<size_t>(-1)
+
+// finishes every shutdown right away
+class SimulatedShutdownExecutor : public ShutdownExecutor
+{
+  public:
+    SimulatedShutdownExecutor(SimulatedBackend& backend)
+      : m_backend(backend),
+        m_finished(false),
+        m_success(false)
+    { }
+
+    virtual bool Start() { return true; }
+    virtual void Stop() { }
+    virtual int GetDescriptor() const { return -1; }
+    virtual void SetOnline(const Machine& machine, bool online) { }
+
+    virtual bool Shutdown(const Machine& machine)
+    {
+      if (m_finished)
+        return false;
+
+      m_success = m_backend.Shutdown(machine, 0, 0);
+      m_finished = true;
+      return true;
+    }
+    virtual bool IsBusy() const { return m_finished; }
+
+    virtual bool GetResult(bool& success)
+    {
+      if (!m_finished)
+        return false;
+
+      success = m_success;
+      m_finished = false;
+      return true;
+    }
+
+  private:
+    SimulatedBackend& m_backend;
+    bool m_finished;
+    bool m_success;
+};
+
+SimulatedBackend::SimulatedBackend(uint64_t seed)
+  : m_hosts(),
+    m_names(),
+    m_hostsById(),
+    m_bootDelay(60 * SECONDS_TO_MICROSECONDS),
+    m_shutdownDelay(10 * SECONDS_TO_MICROSECONDS),
+    m_roundTrips(),
+    m_sent(0),
+    m_replies(),
+    m_random(seed != 0 ? seed : 1),
+    m_wakes(0),
+    m_shutdowns(0)
+{ }
+
+void SimulatedBackend::AddHost(const std::string& name, const SimulatedHost& host)
+{
+  m_names[name] = m_hosts.size();
+  m_hosts.push_back(host);
+}
+
+void SimulatedBackend::SetPowerDelays(Poco::Timestamp::TimeDiff boot, Poco::Timestamp::TimeDiff shutdown)
+{
+  m_bootDelay = boot;
+  m_shutdownDelay = shutdown;
+}
+
+void SimulatedBackend::Attach(const MachineRegistry& registry)
+{
+  m_hostsById.assign(registry.GetSize(), NO_HOST);
+  for (MachineId id = 0; id < registry.GetSize(); ++id)
+  {
+    std::map<std::string, size_t>::const_iterator host = m_names.find(registry.GetMachine(id).GetName());
+    if (host != m_names.end())
+      m_hostsById[id] = host->second;
+  }
+}
+
+bool SimulatedBackend::IsUp(const std::string& name) const
+{
+  std::map<std::string, size_t>::const_iterator host = m_names.find(name);
+  return host != m_names.end() && isUp(host->second, Clock::Now().epochMicroseconds());
+}
+
+bool SimulatedBackend::IsUp(MachineId id) const
+{
+  return id < m_hostsById.size() && m_hostsById[id] != NO_HOST &&
+         isUp(m_hostsById[id], Clock::Now().epochMicroseconds());
+}
+
+size_t SimulatedBackend::Ping(const MachineRegistry& registry, const std::vector<MachineId>& machines, uint8_t timeout,
+                              MachineSet& available, PingObserver* observer)
+{
+  available.Reset(registry.GetSize());
+  m_roundTrips.assign(machines.size(), -1);
+  m_replies.clear();
+  m_sent = 0;
+
+  // all probes are sent at the start of the round
+  const Poco::Timestamp::TimeVal now = Clock::Now().epochMicroseconds();
+  const Poco::Timestamp::TimeDiff maximum = static_cast<Poco::Timestamp::TimeDiff>(timeout) * SECONDS_TO_MICROSECONDS;
+  for (size_t index = 0; index < machines.size(); ++index)
+  {
+    const MachineId id = machines[index];
+    if (id >= m_hostsById.size() || m_hostsById[id] == NO_HOST)
+      continue;
+
+    ++m_sent;
+    const SimulatedHost& host = m_hosts[m_hostsById[id]];
+    if (!isUp(m_hostsById[id], now))
+      continue;
+    if (host.loss > 0.0 && static_cast<double>(random() % 1000000) < host.loss * 1000000.0)
+      continue;
+
+    Poco::Timestamp::TimeDiff roundTrip = host.roundTrip;
+    if (host.jitter > 0)
+      roundTrip += static_cast<Poco::Timestamp::TimeDiff>(random() % static_cast<uint64_t>(2 * host.jitter + 1)) - host.jitter;
+    if (roundTrip < 0)
+      roundTrip = 0;
+    if (roundTrip <= maximum)
+      m_replies.push_back(std::make_pair(roundTrip, index));
+  }
+
+  // the replies arrive in the order of their round trip times
+  std::sort(m_replies.begin(), m_replies.end());
+  Poco::Timestamp::TimeDiff duration = maximum;
+  size_t replies = 0;
+  for (std::vector< std::pair<Poco::Timestamp::TimeDiff, size_t> >::const_iterator reply = m_replies.begin(); reply != m_replies.end(); ++reply)
+  {
+    available.Set(machines[reply->second]);
+    m_roundTrips[reply->second] = reply->first;
+    ++replies;
+
+    // like the real probing the round ends early once everything has
+    // replied or the observer isn't interested in any more replies
+    if (replies == machines.size() || (observer != NULL && observer->Replied(reply->second)))
+    {
+      duration = reply->first;
+      break;
+    }
+  }
+
+  Clock::Advance(duration);
+  return replies;
+}
+
+bool SimulatedBackend::Wake(const Machine& machine)
+{
+  std::map<std::string, size_t>::const_iterator host = m_names.find(machine.GetName());
+  if (host == m_names.end())
+    return false;
+
+  ++m_wakes;
+  schedule(host->second, true, Clock::Now().epochMicroseconds() + m_bootDelay);
+  return true;
+}
+
+bool SimulatedBackend::Shutdown(const Machine& machine, uint16_t connectTimeout, uint16_t executeTimeout)
+{
+  std::map<std::string, size_t>::const_iterator host = m_names.find(machine.GetName());
+  if (host == m_names.end())
+    return false;
+
+  // a machine which is down can't be logged into
+  const Poco::Timestamp::TimeVal now = Clock::Now().epochMicroseconds();
+  if (!isUp(host->second, now))
+    return false;
+
+  ++m_shutdowns;
+  schedule(host->second, false, now + m_shutdownDelay);
+  return true;
+}
+
+ShutdownExecutor* SimulatedBackend::CreateShutdownExecutor(uint16_t connectTimeout, uint16_t executeTimeout)
+{
+  return new SimulatedShutdownExecutor(*this);
+}
+
+bool SimulatedBackend::isUp(size_t host, Poco::Timestamp::TimeVal at) const
+{
+  const std::vector<Poco::Timestamp::TimeVal>& toggles = m_hosts[host].toggles;
+  size_t count = static_cast<size_t>(std::upper_bound(toggles.begin(), toggles.end(), at) - toggles.begin());
+  return m_hosts[host].up != ((count % 2) == 1);
+}
+
+void SimulatedBackend::schedule(size_t host, bool up, Poco::Timestamp::TimeVal at)
+{
+  // anything scripted from then on is overridden by the power change
+  std::vector<Poco::Timestamp::TimeVal>& toggles = m_hosts[host].toggles;
+  toggles.erase(std::upper_bound(toggles.begin(), toggles.end(), at), toggles.end());
+  if (isUp(host, at) != up)
+    toggles.push_back(at);
+}
+
+uint64_t SimulatedBackend::random()
+{
+  // xorshift64
+  m_random ^= m_random << 13;
+  m_random ^= m_random >> 7;
+  m_random ^= m_random << 17;
+  return m_random;
+}
@@ -0,0 +1,111 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+#include <Poco/Timestamp.h>
+
+#include "Backend.h"
+#include "MachineSet.h"
+
+// scripted behaviour of a simulated machine
+typedef struct SimulatedHost
+{
+  SimulatedHost()
+    : up(false),
+      toggles(),
+      roundTrip(1000),
+      jitter(0),
+      loss(0.0)
+  { }
+
+  // state before the first toggle
+  bool up;
+  // ascending points in virtual time (microseconds since the epoch) at which
+  // the machine goes from up to down or the other way round
+  std::vector<Poco::Timestamp::TimeVal> toggles;
+  // round trip time and its maximum deviation in microseconds
+  Poco::Timestamp::TimeDiff roundTrip;
+  Poco::Timestamp::TimeDiff jitter;
+  // probability of a probe or its reply getting lost
+  double loss;
+} SimulatedHost;
+
+// backend without any network access which answers probes according to the
+// scripted timelines of its hosts and advances the virtual Clock by the time
+// every probe round takes
+class SimulatedBackend : public Backend
+{
+  public:
+    SimulatedBackend(uint64_t seed);
+
+    void AddHost(const std::string& name, const SimulatedHost& host);
+    // a woken up server is up after the boot delay, one which is shut down is
+    // down after the shutdown delay
+    void SetPowerDelays(Poco::Timestamp::TimeDiff boot, Poco::Timestamp::TimeDiff shutdown);
+    // resolves the hosts of the machines in the given registry by their name
+    void Attach(const MachineRegistry& registry);
+
+    bool IsUp(const std::string& name) const;
+    bool IsUp(MachineId id) const;
+
+    uint64_t GetWakes() const { return m_wakes; }
+    uint64_t GetShutdowns() const { return m_shutdowns; }
+
+    virtual size_t Ping(const MachineRegistry& registry, const std::vector<MachineId>& machines, uint8_t timeout,
+                        MachineSet& available, PingObserver* observer);
+    virtual const std::vector<Poco::Timestamp::TimeDiff>& GetRoundTrips() const { return m_roundTrips; }
+    virtual size_t GetSent() const { return m_sent; }
+
+    virtual bool Wake(const Machine& machine);
+    virtual bool Shutdown(const Machine& machine, uint16_t connectTimeout, uint16_t executeTimeout);
+    virtual ShutdownExecutor* CreateShutdownExecutor(uint16_t connectTimeout, uint16_t executeTimeout);
+
+  private:
+    SimulatedBackend(const SimulatedBackend&);
+    SimulatedBackend& operator=(const SimulatedBackend&);
+
+    bool isUp(size_t host, Poco::Timestamp::TimeVal at) const;
+    // makes sure the host is in the given state from the given time on
+    void schedule(size_t host, bool up, Poco::Timestamp::TimeVal at);
+    uint64_t random();
+
+    std::vector<SimulatedHost> m_hosts;
+    std::map<std::string, size_t> m_names;
+    std::vector<size_t> m_hostsById;
+
+    Poco::Timestamp::TimeDiff m_bootDelay;
+    Poco::Timestamp::TimeDiff m_shutdownDelay;
+
+    std::vector<Poco::Timestamp::TimeDiff> m_roundTrips;
+    size_t m_sent;
+    // round trip time and index of every reply of the current round
+    std::vector< std::pair<Poco::Timestamp::TimeDiff, size_t> > m_replies;
+    uint64_t m_random;
+
+    uint64_t m_wakes;
+    uint64_t m_shutdowns;
+};
+
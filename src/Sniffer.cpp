@@ -0,0 +1,183 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <log4cxx/logger.h>
+
+#include <arpa/inet.h>
+#include <net/if_arp.h>
+#include <netinet/if_ether.h>
+#include <netinet/ip.h>
+#include <string.h>
+
+#include "Sniffer.h"
+
+// only frames which are sent by a machine on its own are of interest
+#define SNIFFER_FILTER          "arp or (udp and (port 67 or port 68 or port 5353)) or " \
+                                "(icmp6 and (ip6[40] == 135 or ip6[40] == 136))"
+// enough for the ethernet, IP and UDP headers and a complete ARP packet
+#define SNIFFER_SNAPLEN         128
+#define SNIFFER_TIMEOUT         100
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("Sniffer"));
+
+Sniffer::Sniffer()
+  : m_interface(),
+    m_pcap(NULL),
+    m_descriptor(-1)
+{ }
+
+Sniffer::~Sniffer()
+{
+  Close();
+}
+
+bool Sniffer::Open(const std::string& interface)
+{
+  Close();
+
+  char error[PCAP_ERRBUF_SIZE] = { 0 };
+  m_pcap = pcap_create(interface.c_str(), error);
+  if (m_pcap == NULL)
+  {
+    LOG4CXX_ERROR(logger, "Failed to capture on " << interface << ": " << error);
+    return false;
+  }
+
+  pcap_set_snaplen(m_pcap, SNIFFER_SNAPLEN);
+  pcap_set_promisc(m_pcap, 0);
+  pcap_set_timeout(m_pcap, SNIFFER_TIMEOUT);
+  pcap_set_immediate_mode(m_pcap, 1);
+
+  int rc = pcap_activate(m_pcap);
+  if (rc < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to activate capturing on " << interface << ": " << pcap_statustostr(rc));
+    Close();
+    return false;
+  }
+
+  if (pcap_datalink(m_pcap) != DLT_EN10MB)
+  {
+    LOG4CXX_ERROR(logger, interface << " is not an ethernet interface");
+    Close();
+    return false;
+  }
+
+  struct bpf_program filter;
+  if (pcap_compile(m_pcap, &filter, SNIFFER_FILTER, 1, PCAP_NETMASK_UNKNOWN) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to compile the capture filter: " << pcap_geterr(m_pcap));
+    Close();
+    return false;
+  }
+
+  rc = pcap_setfilter(m_pcap, &filter);
+  pcap_freecode(&filter);
+  if (rc < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to apply the capture filter: " << pcap_geterr(m_pcap));
+    Close();
+    return false;
+  }
+
+  // our own frames don't tell anything about other machines
+  if (pcap_setdirection(m_pcap, PCAP_D_IN) < 0)
+    LOG4CXX_DEBUG(logger, "Failed to only capture incoming frames: " << pcap_geterr(m_pcap));
+
+  if (pcap_setnonblock(m_pcap, 1, error) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to switch capturing into non-blocking mode: " << error);
+    Close();
+    return false;
+  }
+
+  m_descriptor = pcap_get_selectable_fd(m_pcap);
+  if (m_descriptor < 0)
+  {
+    LOG4CXX_ERROR(logger, "Capturing on " << interface << " can't be polled");
+    Close();
+    return false;
+  }
+
+  m_interface = interface;
+  LOG4CXX_DEBUG(logger, "Capturing \"" SNIFFER_FILTER "\" on " << m_interface);
+  return true;
+}
+
+void Sniffer::Close()
+{
+  if (m_pcap != NULL)
+    pcap_close(m_pcap);
+
+  m_pcap = NULL;
+  m_descriptor = -1;
+}
+
+void Sniffer::Process(std::vector<Sighting>& sightings)
+{
+  if (m_pcap == NULL)
+    return;
+
+  if (pcap_dispatch(m_pcap, -1, handleFrame, reinterpret_cast<u_char*>(&sightings)) < 0)
+    LOG4CXX_WARN(logger, "Failed to capture on " << m_interface << ": " << pcap_geterr(m_pcap));
+}
+
+void Sniffer::handleFrame(u_char* user, const struct pcap_pkthdr* header, const u_char* frame)
+{
+  std::vector<Sighting>& sightings = *reinterpret_cast<std::vector<Sighting>*>(user);
+  if (header->caplen < sizeof(struct ether_header))
+    return;
+
+  const struct ether_header* etherHeader = reinterpret_cast<const struct ether_header*>(frame);
+  const u_char* payload = frame + sizeof(struct ether_header);
+  size_t payloadLength = header->caplen - sizeof(struct ether_header);
+
+  Sighting sighting;
+  memcpy(sighting.mac, etherHeader->ether_shost, ETH_ALEN);
+  sighting.ip = INADDR_ANY;
+
+  switch (ntohs(etherHeader->ether_type))
+  {
+    case ETHERTYPE_ARP:
+    {
+      if (payloadLength < sizeof(struct ether_arp))
+        return;
+
+      // gratuitous ARP packets and probes carry the sender's address too
+      const struct ether_arp* arp = reinterpret_cast<const struct ether_arp*>(payload);
+      memcpy(&sighting.ip, arp->arp_spa, sizeof(sighting.ip));
+      break;
+    }
+
+    case ETHERTYPE_IP:
+    {
+      // DHCP clients without a lease send from the unspecified address
+      if (payloadLength >= sizeof(struct iphdr))
+        sighting.ip = reinterpret_cast<const struct iphdr*>(payload)->saddr;
+      break;
+    }
+
+    default:
+      // mDNS over IPv6 and neighbor discovery only reveal the MAC address
+      break;
+  }
+
+  sightings.push_back(sighting);
+}
+
@@ -0,0 +1,54 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include <pcap/pcap.h>
+
+#include "Sighting.h"
+
+class Sniffer
+{
+  public:
+    Sniffer();
+    ~Sniffer();
+
+    // starts passively capturing ARP, DHCP and mDNS frames on the interface
+    bool Open(const std::string& interface);
+    void Close();
+
+    bool IsOpen() const { return m_pcap != NULL; }
+    int GetDescriptor() const { return m_descriptor; }
+
+    // processes all pending frames and appends the senders to the sightings
+    void Process(std::vector<Sighting>& sightings);
+
+  private:
+    Sniffer(const Sniffer&);
+    Sniffer& operator=(const Sniffer&);
+
+    static void handleFrame(u_char* user, const struct pcap_pkthdr* header, const u_char* frame);
+
+    std::string m_interface;
+    pcap_t* m_pcap;
+    int m_descriptor;
+};
+
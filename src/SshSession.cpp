@@ -0,0 +1,154 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <log4cxx/logger.h>
+
+#include "SshSession.h"
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("SshSession"));
+
+SshSession::SshSession()
+  : m_session(NULL),
+    m_host(),
+    m_username()
+{ }
+
+SshSession::~SshSession()
+{
+  Disconnect();
+}
+
+bool SshSession::Connect(const std::string& host, const std::string& username, const std::string& password, uint16_t timeout)
+{
+  Disconnect();
+
+  if (host.empty() || username.empty())
+  {
+    LOG4CXX_ERROR(logger, "Missing IP address (" << host << ") or username (" << username << ")");
+    return false;
+  }
+
+  m_session = ssh_new();
+  if (m_session == NULL)
+  {
+    LOG4CXX_ERROR(logger, "libssh error (ssh_new)");
+    return false;
+  }
+
+  // set the remote host, the user to be used and the connection timeout
+  long connectTimeout = timeout;
+  ssh_options_set(m_session, SSH_OPTIONS_HOST, host.c_str());
+  ssh_options_set(m_session, SSH_OPTIONS_USER, username.c_str());
+  ssh_options_set(m_session, SSH_OPTIONS_TIMEOUT, &connectTimeout);
+
+  LOG4CXX_DEBUG(logger, "Connecting to " << host << " as " << username << " over SSH...");
+  int rc = ssh_connect(m_session);
+  if (rc != SSH_OK)
+  {
+    LOG4CXX_ERROR(logger, "Unable to connect to " << host << " as " << username << " (" << rc << "): " << ssh_get_error(m_session));
+    ssh_free(m_session);
+    m_session = NULL;
+    return false;
+  }
+
+  if (!password.empty())
+  {
+    LOG4CXX_DEBUG(logger, "Authenticating as " << username << " on " << host << " over SSH...");
+    rc = ssh_userauth_password(m_session, NULL, password.c_str());
+    if (rc != SSH_AUTH_SUCCESS)
+    {
+      LOG4CXX_ERROR(logger, "Authentication as " << username << " failed on " << host << " (" << rc << ")");
+      ssh_disconnect(m_session);
+      ssh_free(m_session);
+      m_session = NULL;
+      return false;
+    }
+  }
+
+  m_host = host;
+  m_username = username;
+  return true;
+}
+
+void SshSession::Disconnect()
+{
+  if (m_session == NULL)
+    return;
+
+  LOG4CXX_TRACE(logger, "Disconnecting from " << m_host << "...");
+  ssh_disconnect(m_session);
+  ssh_free(m_session);
+  m_session = NULL;
+}
+
+bool SshSession::IsConnected() const
+{
+  return m_session != NULL && ssh_is_connected(m_session) != 0;
+}
+
+bool SshSession::KeepAlive()
+{
+  if (!IsConnected())
+    return false;
+
+  if (ssh_send_ignore(m_session, "keepalive") != SSH_OK)
+  {
+    LOG4CXX_DEBUG(logger, "SSH connection to " << m_host << " has been lost");
+    Disconnect();
+    return false;
+  }
+
+  return true;
+}
+
+bool SshSession::Execute(const std::string& command, uint16_t timeout)
+{
+  if (!IsConnected())
+    return false;
+
+  // all the following blocking calls are bound by the session's timeout
+  long executeTimeout = timeout;
+  ssh_options_set(m_session, SSH_OPTIONS_TIMEOUT, &executeTimeout);
+
+  ssh_channel channel = ssh_channel_new(m_session);
+  if (channel == NULL)
+  {
+    LOG4CXX_ERROR(logger, "libssh error (ssh_channel_new)");
+    return false;
+  }
+
+  int rc = ssh_channel_open_session(channel);
+  if (rc != SSH_OK)
+  {
+    LOG4CXX_ERROR(logger, "Unable to open a new SSH channel on " << m_host << " (" << rc << ")");
+    ssh_channel_free(channel);
+    return false;
+  }
+
+  LOG4CXX_DEBUG(logger, "Executing '" << command << "' on " << m_host << " as " << m_username << "...");
+  rc = ssh_channel_request_exec(channel, command.c_str());
+  if (rc != SSH_OK)
+    LOG4CXX_ERROR(logger, "Failed to execute '" << command << "' on " << m_host << " as " << m_username << " (" << rc << ")");
+
+  ssh_channel_close(channel);
+  ssh_channel_free(channel);
+
+  return rc == SSH_OK;
+}
+
@@ -0,0 +1,56 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+
+#include <stdint.h>
+
+#include <libssh/libssh.h>
+
+class SshSession
+{
+  public:
+    SshSession();
+    ~SshSession();
+
+    // connects and authenticates to the given host within the timeout (in
+    // seconds)
+    bool Connect(const std::string& host, const std::string& username, const std::string& password, uint16_t timeout);
+    void Disconnect();
+
+    bool IsConnected() const;
+    const std::string& GetHost() const { return m_host; }
+
+    // checks whether the connection is still usable
+    bool KeepAlive();
+
+    // executes the given command in a new channel within the timeout (in
+    // seconds)
+    bool Execute(const std::string& command, uint16_t timeout);
+
+  private:
+    SshSession(const SshSession&);
+    SshSession& operator=(const SshSession&);
+
+    ssh_session m_session;
+    std::string m_host;
+    std::string m_username;
+};
+
@@ -0,0 +1,226 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <log4cxx/logger.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "Machine.h"
+#include "SshShutdownExecutor.h"
+
+#define SHUTDOWN_COMMAND        "shutdown -h now"
+// how often the warm session is checked and re-established (in milliseconds)
+#define SHUTDOWN_KEEPALIVE      30000
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("SshShutdownExecutor"));
+
+SshShutdownExecutor::SshShutdownExecutor(uint16_t connectTimeout, uint16_t executeTimeout)
+  : m_connectTimeout(connectTimeout),
+    m_executeTimeout(executeTimeout),
+    m_thread(),
+    m_wakeup(true),
+    m_mutex(),
+    m_event(-1),
+    m_stop(false),
+    m_host(),
+    m_username(),
+    m_password(),
+    m_online(false),
+    m_shutdownRequested(false),
+    m_busy(false),
+    m_finished(false),
+    m_success(false),
+    m_session()
+{
+  m_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_event < 0)
+    LOG4CXX_ERROR(logger, "Failed to create an event descriptor: " << strerror(errno));
+}
+
+SshShutdownExecutor::~SshShutdownExecutor()
+{
+  Stop();
+
+  if (m_event >= 0)
+    close(m_event);
+}
+
+bool SshShutdownExecutor::Start()
+{
+  if (m_event < 0)
+    return false;
+
+  m_thread.setName("ShutdownExecutor");
+  m_thread.start(*this);
+  return true;
+}
+
+void SshShutdownExecutor::Stop()
+{
+  {
+    Poco::Mutex::ScopedLock lock(m_mutex);
+    m_stop = true;
+  }
+
+  m_wakeup.set();
+  if (m_thread.isRunning())
+    m_thread.join();
+}
+
+void SshShutdownExecutor::SetOnline(const Machine& machine, bool online)
+{
+  {
+    Poco::Mutex::ScopedLock lock(m_mutex);
+    if (online == m_online && machine.GetIpAddress() == m_host)
+      return;
+
+    setMachine(machine);
+    m_online = online;
+  }
+
+  m_wakeup.set();
+}
+
+bool SshShutdownExecutor::Shutdown(const Machine& machine)
+{
+  {
+    Poco::Mutex::ScopedLock lock(m_mutex);
+    if (m_busy)
+      return false;
+
+    setMachine(machine);
+    m_shutdownRequested = true;
+    m_busy = true;
+    m_finished = false;
+  }
+
+  m_wakeup.set();
+  return true;
+}
+
+bool SshShutdownExecutor::IsBusy() const
+{
+  Poco::Mutex::ScopedLock lock(m_mutex);
+  return m_busy;
+}
+
+bool SshShutdownExecutor::GetResult(bool& success)
+{
+  uint64_t value;
+  if (read(m_event, &value, sizeof(value)) < 0 && errno != EAGAIN)
+    LOG4CXX_WARN(logger, "Failed to read the event descriptor: " << strerror(errno));
+
+  Poco::Mutex::ScopedLock lock(m_mutex);
+  if (!m_finished)
+    return false;
+
+  success = m_success;
+  m_finished = false;
+  m_busy = false;
+  return true;
+}
+
+void SshShutdownExecutor::run()
+{
+  LOG4CXX_DEBUG(logger, "Shutdown executor started");
+  while (true)
+  {
+    m_wakeup.tryWait(SHUTDOWN_KEEPALIVE);
+
+    bool shutdown, online;
+    std::string host;
+    {
+      Poco::Mutex::ScopedLock lock(m_mutex);
+      if (m_stop)
+        break;
+
+      shutdown = m_shutdownRequested;
+      online = m_online;
+      host = m_host;
+      m_shutdownRequested = false;
+    }
+
+    // the session may still belong to a previously configured machine
+    if (m_session.IsConnected() && m_session.GetHost() != host)
+      m_session.Disconnect();
+
+    if (shutdown)
+    {
+      // re-use the warm session if it is still alive, a keep-alive only
+      // queues a packet so a half-open session (e.g. after the server
+      // rebooted) is only noticed when executing fails and gets a fresh
+      // connection right away
+      bool reused = m_session.KeepAlive();
+      bool success = (reused || connect()) &&
+                     m_session.Execute(SHUTDOWN_COMMAND, m_executeTimeout);
+      if (!success && reused)
+      {
+        LOG4CXX_DEBUG(logger, "Executing over the warm session to " << host << " failed, reconnecting");
+        m_session.Disconnect();
+        success = connect() && m_session.Execute(SHUTDOWN_COMMAND, m_executeTimeout);
+      }
+      m_session.Disconnect();
+
+      {
+        Poco::Mutex::ScopedLock lock(m_mutex);
+        m_success = success;
+        m_finished = true;
+        m_online = false;
+      }
+
+      uint64_t value = 1;
+      if (write(m_event, &value, sizeof(value)) < 0)
+        LOG4CXX_ERROR(logger, "Failed to signal the end of the shutdown: " << strerror(errno));
+    }
+    else if (online)
+    {
+      if (!m_session.KeepAlive())
+        connect();
+    }
+    else if (m_session.IsConnected())
+      m_session.Disconnect();
+  }
+
+  m_session.Disconnect();
+  LOG4CXX_DEBUG(logger, "Shutdown executor stopped");
+}
+
+void SshShutdownExecutor::setMachine(const Machine& machine)
+{
+  m_host = machine.GetIpAddress();
+  m_username = machine.GetUsername();
+  m_password = machine.GetPassword();
+}
+
+bool SshShutdownExecutor::connect()
+{
+  std::string host, username, password;
+  {
+    Poco::Mutex::ScopedLock lock(m_mutex);
+    host = m_host;
+    username = m_username;
+    password = m_password;
+  }
+
+  return m_session.Connect(host, username, password, m_connectTimeout);
+}
+
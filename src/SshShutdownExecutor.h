@@ -0,0 +1,86 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+
+#include <stdint.h>
+
+#include <Poco/Event.h>
+#include <Poco/Mutex.h>
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
+
+#include "ShutdownExecutor.h"
+#include "SshSession.h"
+
+class Machine;
+
+// shuts machines down over SSH on its own thread
+class SshShutdownExecutor : public ShutdownExecutor, public Poco::Runnable
+{
+  public:
+    SshShutdownExecutor(uint16_t connectTimeout, uint16_t executeTimeout);
+    virtual ~SshShutdownExecutor();
+
+    virtual bool Start();
+    virtual void Stop();
+
+    virtual int GetDescriptor() const { return m_event; }
+
+    // keeps an authenticated SSH session to the machine open while it is
+    // online so that shutting it down only needs a single channel
+    virtual void SetOnline(const Machine& machine, bool online);
+
+    virtual bool Shutdown(const Machine& machine);
+    virtual bool IsBusy() const;
+    virtual bool GetResult(bool& success);
+
+    virtual void run();
+
+  private:
+    SshShutdownExecutor(const SshShutdownExecutor&);
+    SshShutdownExecutor& operator=(const SshShutdownExecutor&);
+
+    void setMachine(const Machine& machine);
+    bool connect();
+
+    const uint16_t m_connectTimeout;
+    const uint16_t m_executeTimeout;
+
+    Poco::Thread m_thread;
+    Poco::Event m_wakeup;
+    mutable Poco::Mutex m_mutex;
+    int m_event;
+
+    // protected by m_mutex
+    bool m_stop;
+    std::string m_host;
+    std::string m_username;
+    std::string m_password;
+    bool m_online;
+    bool m_shutdownRequested;
+    bool m_busy;
+    bool m_finished;
+    bool m_success;
+
+    // only used by the executor's thread
+    SshSession m_session;
+};
+
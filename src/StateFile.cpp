@@ -0,0 +1,240 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <log4cxx/logger.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Machine.h"
+#include "MachineRegistry.h"
+#include "StateFile.h"
+
+#define STATE_FILE_MAGIC        "HMSTATE"
+#define STATE_FILE_VERSION      1
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("StateFile"));
+
+StateFile::StateFile()
+  : m_path(),
+    m_file(-1),
+    m_data(MAP_FAILED),
+    m_size(0),
+    m_header(NULL),
+    m_entries(NULL),
+    m_names()
+{ }
+
+StateFile::~StateFile()
+{
+  unmap();
+
+  if (m_file >= 0)
+    close(m_file);
+}
+
+bool StateFile::Open(const std::string& path)
+{
+  m_path = path;
+  m_file = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (m_file < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to open " << path << ": " << strerror(errno));
+    return false;
+  }
+
+  struct stat status;
+  if (fstat(m_file, &status) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to determine the size of " << path << ": " << strerror(errno));
+    return false;
+  }
+
+  // an invalid file is simply started over
+  uint32_t count = 0;
+  if (static_cast<size_t>(status.st_size) >= sizeof(StateFileHeader))
+  {
+    StateFileHeader header;
+    if (pread(m_file, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+        memcmp(header.magic, STATE_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+        header.version == STATE_FILE_VERSION &&
+        static_cast<size_t>(status.st_size) == sizeof(StateFileHeader) + header.count * sizeof(StateFileEntry))
+      count = header.count;
+    else
+      LOG4CXX_WARN(logger, "Ignoring the invalid state file " << path);
+  }
+
+  if (!map(count))
+    return false;
+
+  for (uint32_t index = 0; index < count; ++index)
+  {
+    const StateFileEntry& entry = m_entries[index];
+    m_names.insert(std::make_pair(std::string(entry.name, strnlen(entry.name, sizeof(entry.name))), index));
+  }
+
+  return true;
+}
+
+bool StateFile::Find(const MachineRegistry& registry, MachineId id, bool server, in_addr_t& ip,
+                     bool& online, Poco::Timestamp& lastSeen, Poco::Timestamp& lastChange) const
+{
+  if (m_entries == NULL)
+    return false;
+
+  // unless the configuration has changed every machine is still in its slot
+  const Machine& machine = registry.GetMachine(id);
+  const StateFileEntry* entry = NULL;
+  if (id < m_header->count && matches(m_entries[id], registry, id, server))
+    entry = &m_entries[id];
+  else
+  {
+    std::map<std::string, uint32_t>::const_iterator name = m_names.find(machine.GetName().substr(0, STATE_FILE_NAME_SIZE - 1));
+    if (name == m_names.end() || !matches(m_entries[name->second], registry, id, server))
+      return false;
+
+    entry = &m_entries[name->second];
+  }
+
+  ip = entry->ip;
+  online = entry->online != 0;
+  lastSeen = Poco::Timestamp(entry->lastSeen);
+  lastChange = Poco::Timestamp(entry->lastChange);
+  return true;
+}
+
+bool StateFile::Layout(const MachineRegistry& registry, size_t servers)
+{
+  if (m_file < 0)
+    return false;
+
+  const uint32_t count = static_cast<uint32_t>(registry.GetSize());
+  if ((m_header == NULL || m_header->count != count) && !map(count))
+    return false;
+
+  memcpy(m_header->magic, STATE_FILE_MAGIC, sizeof(m_header->magic));
+  m_header->version = STATE_FILE_VERSION;
+  m_header->count = count;
+
+  for (MachineId id = 0; id < count; ++id)
+  {
+    const Machine& machine = registry.GetMachine(id);
+    StateFileEntry& entry = m_entries[id];
+    memset(&entry, 0, sizeof(entry));
+
+    strncpy(entry.name, machine.GetName().c_str(), sizeof(entry.name) - 1);
+    memcpy(entry.mac, registry.GetMac(id), ETH_ALEN);
+    entry.server = id < servers ? 1 : 0;
+    entry.online = registry.IsOnline(id) ? 1 : 0;
+    entry.ip = registry.GetIp(id);
+    entry.lastSeen = registry.GetLastSeen(id).epochMicroseconds();
+  }
+
+  // the old slots are gone
+  m_names.clear();
+  return true;
+}
+
+void StateFile::SetIp(MachineId id, in_addr_t ip)
+{
+  if (m_entries == NULL || id >= m_header->count)
+    return;
+
+  m_entries[id].ip = ip;
+}
+
+void StateFile::SetOnline(MachineId id, bool online, const Poco::Timestamp& lastSeen)
+{
+  if (m_entries == NULL || id >= m_header->count)
+    return;
+
+  m_entries[id].online = online ? 1 : 0;
+  m_entries[id].lastSeen = lastSeen.epochMicroseconds();
+}
+
+void StateFile::SetLastChange(MachineId id, const Poco::Timestamp& lastChange)
+{
+  if (m_entries == NULL || id >= m_header->count)
+    return;
+
+  m_entries[id].lastChange = lastChange.epochMicroseconds();
+}
+
+bool StateFile::map(uint32_t count)
+{
+  unmap();
+
+  size_t size = sizeof(StateFileHeader) + count * sizeof(StateFileEntry);
+  if (ftruncate(m_file, static_cast<off_t>(size)) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to resize " << m_path << ": " << strerror(errno));
+    return false;
+  }
+
+  m_data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+  if (m_data == MAP_FAILED)
+  {
+    LOG4CXX_ERROR(logger, "Failed to map " << m_path << ": " << strerror(errno));
+    return false;
+  }
+
+  m_size = size;
+  m_header = static_cast<StateFileHeader*>(m_data);
+  m_entries = reinterpret_cast<StateFileEntry*>(static_cast<uint8_t*>(m_data) + sizeof(StateFileHeader));
+
+  // a new file needs a valid header right away
+  if (memcmp(m_header->magic, STATE_FILE_MAGIC, sizeof(m_header->magic)) != 0 ||
+      m_header->version != STATE_FILE_VERSION || m_header->count != count)
+  {
+    memset(m_data, 0, size);
+    memcpy(m_header->magic, STATE_FILE_MAGIC, sizeof(m_header->magic));
+    m_header->version = STATE_FILE_VERSION;
+    m_header->count = count;
+  }
+
+  return true;
+}
+
+void StateFile::unmap()
+{
+  if (m_data != MAP_FAILED)
+  {
+    // the kernel writes the pages back anyway, this only makes sure they
+    // are on disk when the daemon stops
+    msync(m_data, m_size, MS_SYNC);
+    munmap(m_data, m_size);
+  }
+
+  m_data = MAP_FAILED;
+  m_size = 0;
+  m_header = NULL;
+  m_entries = NULL;
+}
+
+bool StateFile::matches(const StateFileEntry& entry, const MachineRegistry& registry, MachineId id, bool server) const
+{
+  return (entry.server != 0) == server &&
+         memcmp(entry.mac, registry.GetMac(id), ETH_ALEN) == 0 &&
+         strncmp(entry.name, registry.GetMachine(id).GetName().c_str(), sizeof(entry.name) - 1) == 0;
+}
@@ -0,0 +1,102 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <map>
+#include <string>
+
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+
+#include <Poco/Timestamp.h>
+
+#include "MachineSet.h"
+
+class MachineRegistry;
+
+// fixed layout of the state file, all values are stored in host byte order
+// except for the IP address
+typedef struct StateFileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t count;
+} StateFileHeader;
+
+#define STATE_FILE_NAME_SIZE    64
+
+typedef struct StateFileEntry
+{
+  char name[STATE_FILE_NAME_SIZE];
+  uint8_t mac[ETH_ALEN];
+  uint8_t server;
+  uint8_t online;
+  uint32_t ip;
+  uint32_t reserved;
+  // microseconds since the epoch
+  int64_t lastSeen;
+  int64_t lastChange;
+} StateFileEntry;
+
+// memory-mapped file holding the presence state of every machine indexed by
+// its identifier so that it survives restarts of the daemon
+class StateFile
+{
+  public:
+    StateFile();
+    ~StateFile();
+
+    // maps the given file, an invalid or missing file is treated as empty
+    bool Open(const std::string& path);
+    bool IsOpen() const { return m_entries != NULL; }
+
+    // looks up the recorded state of the given machine by its name and MAC
+    // address, returns false if it is unknown or its MAC address has changed,
+    // the IP address may have been discovered and is part of the state
+    bool Find(const MachineRegistry& registry, MachineId id, bool server, in_addr_t& ip,
+              bool& online, Poco::Timestamp& lastSeen, Poco::Timestamp& lastChange) const;
+
+    // rewrites the file for the machines of the given registry of which the
+    // given number of leading ones are servers
+    bool Layout(const MachineRegistry& registry, size_t servers);
+
+    void SetIp(MachineId id, in_addr_t ip);
+    void SetOnline(MachineId id, bool online, const Poco::Timestamp& lastSeen);
+    void SetLastChange(MachineId id, const Poco::Timestamp& lastChange);
+
+  private:
+    StateFile(const StateFile&);
+    StateFile& operator=(const StateFile&);
+
+    bool map(uint32_t count);
+    void unmap();
+    bool matches(const StateFileEntry& entry, const MachineRegistry& registry, MachineId id, bool server) const;
+
+    std::string m_path;
+    int m_file;
+    void* m_data;
+    size_t m_size;
+    StateFileHeader* m_header;
+    StateFileEntry* m_entries;
+
+    // entries of the file as it has been found by their name
+    std::map<std::string, uint32_t> m_names;
+};
+
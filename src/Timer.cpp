@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <log4cxx/logger.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "Timer.h"
+
+#define SECONDS_TO_MICROSECONDS 1000000
+#define MICROSECONDS_TO_NANOSECONDS 1000
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("Timer"));
+
+static void toTimespec(Poco::Timestamp::TimeDiff microseconds, struct timespec& time)
+{
+  time.tv_sec = static_cast<time_t>(microseconds / SECONDS_TO_MICROSECONDS);
+  time.tv_nsec = static_cast<long>((microseconds % SECONDS_TO_MICROSECONDS) * MICROSECONDS_TO_NANOSECONDS);
+}
+
+Timer::Timer()
+  : m_timer(-1)
+{
+  m_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (m_timer < 0)
+    LOG4CXX_ERROR(logger, "Failed to create a timer: " << strerror(errno));
+}
+
+Timer::~Timer()
+{
+  if (m_timer >= 0)
+    close(m_timer);
+}
+
+bool Timer::Start(Poco::Timestamp::TimeDiff delay, Poco::Timestamp::TimeDiff interval /* = 0 */)
+{
+  if (m_timer < 0)
+    return false;
+
+  // a zero delay would disarm the timer
+  if (delay <= 0)
+    delay = 1;
+
+  struct itimerspec spec;
+  toTimespec(delay, spec.it_value);
+  toTimespec(interval, spec.it_interval);
+  if (timerfd_settime(m_timer, 0, &spec, NULL) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to arm the timer: " << strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+bool Timer::StartAt(const Poco::Timestamp& deadline)
+{
+  return Start(deadline - Poco::Timestamp());
+}
+
+void Timer::Stop()
+{
+  if (m_timer < 0)
+    return;
+
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  timerfd_settime(m_timer, 0, &spec, NULL);
+}
+
+uint64_t Timer::Acknowledge()
+{
+  uint64_t expirations = 0;
+  if (m_timer < 0 || read(m_timer, &expirations, sizeof(expirations)) != sizeof(expirations))
+    return 0;
+
+  return expirations;
+}
+
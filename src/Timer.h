@@ -0,0 +1,46 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Poco/Timestamp.h>
+
+class Timer
+{
+  public:
+    Timer();
+    ~Timer();
+
+    int GetDescriptor() const { return m_timer; }
+
+    // arms the timer to expire after the given delay and then every interval
+    // (if not zero), both in microseconds
+    bool Start(Poco::Timestamp::TimeDiff delay, Poco::Timestamp::TimeDiff interval = 0);
+    bool StartAt(const Poco::Timestamp& deadline);
+    void Stop();
+
+    // consumes the pending expirations and returns their number
+    uint64_t Acknowledge();
+
+  private:
+    Timer(const Timer&);
+    Timer& operator=(const Timer&);
+
+    int m_timer;
+};
+
@@ -0,0 +1,480 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+
+#include <log4cxx/logger.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Clock.h"
+#include "Machine.h"
+#include "MachineRegistry.h"
+#include "Trace.h"
+
+#define TRACE_MAGIC             "HMTRACE"
+#define TRACE_VERSION           1
+#define TRACE_HEADER_SIZE       12
+
+// the buffer is written out once it holds more than this
+#define TRACE_BUFFER_SIZE       (64 * 1024)
+
+#define SECONDS_TO_MICROSECONDS 1000000
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("Trace"));
+
+// the records are timed by the monotonic clock so that they stay in order
+// when the wall clock jumps
+static int64_t monotonicNow()
+{
+  if (Clock::IsVirtual())
+    return Clock::Now().epochMicroseconds();
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<int64_t>(now.tv_sec) * SECONDS_TO_MICROSECONDS + now.tv_nsec / 1000;
+}
+
+TraceWriter::TraceWriter()
+  : m_path(),
+    m_file(-1),
+    m_buffer(),
+    m_last(0)
+{ }
+
+TraceWriter::~TraceWriter()
+{
+  Close();
+}
+
+bool TraceWriter::Open(const std::string& path)
+{
+  Close();
+
+  // every run of the daemon appends a new session to the same file
+  m_path = path;
+  m_file = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (m_file < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to open " << path << ": " << strerror(errno));
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(m_file, &info) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to determine the size of " << path << ": " << strerror(errno));
+    Close();
+    return false;
+  }
+
+  m_buffer.reserve(TRACE_BUFFER_SIZE + TRACE_BUFFER_SIZE / 4);
+  if (info.st_size == 0)
+  {
+    const uint32_t version = TRACE_VERSION;
+    m_buffer.insert(m_buffer.end(), TRACE_MAGIC, TRACE_MAGIC + sizeof(TRACE_MAGIC));
+    m_buffer.insert(m_buffer.end(), reinterpret_cast<const uint8_t*>(&version), reinterpret_cast<const uint8_t*>(&version) + sizeof(version));
+  }
+
+  m_buffer.push_back(TraceRecordStart);
+  put(static_cast<uint64_t>(Clock::Now().epochMicroseconds()));
+  m_last = monotonicNow();
+  Flush();
+
+  return IsOpen();
+}
+
+void TraceWriter::Close()
+{
+  if (m_file < 0)
+    return;
+
+  Flush();
+  if (m_file >= 0)
+    close(m_file);
+  m_file = -1;
+  m_buffer.clear();
+}
+
+void TraceWriter::WriteMachines(const MachineRegistry& registry, const std::vector<Poco::Timestamp>& lastChanges)
+{
+  if (m_file < 0)
+    return;
+
+  begin(TraceRecordMachines);
+  put(registry.GetSize());
+  put(lastChanges.size());
+  for (MachineId id = 0; id < registry.GetSize(); ++id)
+  {
+    put(registry.GetMachine(id).GetName());
+    m_buffer.push_back(registry.IsOnline(id) ? 1 : 0);
+    put(static_cast<uint64_t>(registry.GetLastSeen(id).epochMicroseconds()));
+  }
+  for (std::vector<Poco::Timestamp>::const_iterator lastChange = lastChanges.begin(); lastChange != lastChanges.end(); ++lastChange)
+    put(static_cast<uint64_t>(lastChange->epochMicroseconds()));
+  end();
+}
+
+void TraceWriter::WriteRound(const std::vector<MachineId>& machines, const std::vector<Poco::Timestamp::TimeDiff>& roundTrips)
+{
+  if (m_file < 0)
+    return;
+
+  begin(TraceRecordRound);
+  put(machines.size());
+  for (size_t index = 0; index < machines.size(); ++index)
+  {
+    put(machines[index]);
+    put(static_cast<uint64_t>(roundTrips[index] + 1));
+  }
+  end();
+}
+
+void TraceWriter::WriteSighting(TraceRecordType type, const Sighting& sighting)
+{
+  if (m_file < 0)
+    return;
+
+  begin(type);
+  m_buffer.insert(m_buffer.end(), sighting.mac, sighting.mac + sizeof(sighting.mac));
+  m_buffer.insert(m_buffer.end(), reinterpret_cast<const uint8_t*>(&sighting.ip), reinterpret_cast<const uint8_t*>(&sighting.ip) + sizeof(sighting.ip));
+  end();
+}
+
+void TraceWriter::WriteEvent(TraceRecordType type)
+{
+  if (m_file < 0)
+    return;
+
+  begin(type);
+  end();
+}
+
+void TraceWriter::WriteValue(TraceRecordType type, uint8_t value)
+{
+  if (m_file < 0)
+    return;
+
+  begin(type);
+  m_buffer.push_back(value);
+  end();
+}
+
+void TraceWriter::WriteManual(TraceRecordType type, const std::string& name, uint8_t value /* = 0 */)
+{
+  if (m_file < 0)
+    return;
+
+  begin(type);
+  put(name);
+  m_buffer.push_back(value);
+  end();
+}
+
+void TraceWriter::WriteAction(TraceRecordType type, MachineId server, uint8_t value /* = 0 */)
+{
+  if (m_file < 0)
+    return;
+
+  begin(type);
+  put(server);
+  m_buffer.push_back(value);
+  end();
+}
+
+void TraceWriter::Flush()
+{
+  if (m_file < 0 || m_buffer.empty())
+    return;
+
+  size_t written = 0;
+  while (written < m_buffer.size())
+  {
+    ssize_t result = write(m_file, &m_buffer[written], m_buffer.size() - written);
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result <= 0)
+    {
+      LOG4CXX_ERROR(logger, "Failed to write to " << m_path << ", no longer tracing: " << strerror(errno));
+      close(m_file);
+      m_file = -1;
+      break;
+    }
+
+    written += static_cast<size_t>(result);
+  }
+
+  m_buffer.clear();
+}
+
+void TraceWriter::begin(TraceRecordType type)
+{
+  const int64_t now = monotonicNow();
+  m_buffer.push_back(static_cast<uint8_t>(type));
+  put(static_cast<uint64_t>(now > m_last ? now - m_last : 0));
+  m_last = std::max(m_last, now);
+}
+
+void TraceWriter::put(uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    m_buffer.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  m_buffer.push_back(static_cast<uint8_t>(value));
+}
+
+void TraceWriter::put(const std::string& value)
+{
+  put(value.size());
+  m_buffer.insert(m_buffer.end(), value.begin(), value.end());
+}
+
+void TraceWriter::end()
+{
+  if (m_buffer.size() >= TRACE_BUFFER_SIZE)
+    Flush();
+}
+
+TraceReader::TraceReader()
+  : m_file(-1),
+    m_data(NULL),
+    m_size(0),
+    m_position(0),
+    m_time(0)
+{ }
+
+TraceReader::~TraceReader()
+{
+  Close();
+}
+
+bool TraceReader::Open(const std::string& path)
+{
+  Close();
+
+  m_file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (m_file < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to open " << path << ": " << strerror(errno));
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(m_file, &info) < 0)
+  {
+    LOG4CXX_ERROR(logger, "Failed to determine the size of " << path << ": " << strerror(errno));
+    Close();
+    return false;
+  }
+
+  uint32_t version = 0;
+  if (info.st_size >= TRACE_HEADER_SIZE)
+  {
+    void* data = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, m_file, 0);
+    if (data == MAP_FAILED)
+    {
+      LOG4CXX_ERROR(logger, "Failed to map " << path << ": " << strerror(errno));
+      Close();
+      return false;
+    }
+
+    // the records are read once from start to end
+    madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = static_cast<size_t>(info.st_size);
+    memcpy(&version, m_data + sizeof(TRACE_MAGIC), sizeof(version));
+  }
+
+  if (m_data == NULL || memcmp(m_data, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 || version != TRACE_VERSION)
+  {
+    LOG4CXX_ERROR(logger, path << " is not a valid trace file");
+    Close();
+    return false;
+  }
+
+  m_position = TRACE_HEADER_SIZE;
+  m_time = 0;
+  return true;
+}
+
+void TraceReader::Close()
+{
+  if (m_data != NULL)
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+  m_data = NULL;
+  m_size = 0;
+  m_position = 0;
+
+  if (m_file >= 0)
+    close(m_file);
+  m_file = -1;
+}
+
+bool TraceReader::Next(TraceRecord& record)
+{
+  if (m_data == NULL || m_position >= m_size)
+    return false;
+
+  // the position only moves on once the whole record has been read
+  const size_t start = m_position;
+  uint64_t value;
+  record.type = static_cast<TraceRecordType>(m_data[m_position++]);
+  if (!get(value))
+  {
+    m_position = start;
+    return false;
+  }
+
+  Poco::Timestamp::TimeVal time = record.type == TraceRecordStart ? static_cast<Poco::Timestamp::TimeVal>(value) : m_time + static_cast<Poco::Timestamp::TimeVal>(value);
+  bool valid = true;
+  switch (record.type)
+  {
+    case TraceRecordStart:
+    case TraceRecordExpire:
+    case TraceRecordDecide:
+      break;
+
+    case TraceRecordMachines:
+    {
+      uint64_t count, servers;
+      valid = get(count) && get(servers) && servers <= count && count <= m_size;
+      if (!valid)
+        break;
+
+      record.servers = static_cast<size_t>(servers);
+      record.names.resize(static_cast<size_t>(count));
+      record.online.resize(static_cast<size_t>(count));
+      record.lastSeen.resize(static_cast<size_t>(count));
+      record.lastChange.resize(static_cast<size_t>(servers));
+      for (size_t index = 0; index < count && valid; ++index)
+      {
+        valid = get(record.names[index]) && get(&record.online[index], 1) && get(value);
+        record.lastSeen[index] = Poco::Timestamp(static_cast<Poco::Timestamp::TimeVal>(value));
+      }
+      for (size_t index = 0; index < servers && valid; ++index)
+      {
+        valid = get(value);
+        record.lastChange[index] = Poco::Timestamp(static_cast<Poco::Timestamp::TimeVal>(value));
+      }
+      break;
+    }
+
+    case TraceRecordRound:
+    {
+      uint64_t count;
+      valid = get(count) && count <= m_size;
+      if (!valid)
+        break;
+
+      record.machines.resize(static_cast<size_t>(count));
+      record.roundTrips.resize(static_cast<size_t>(count));
+      for (size_t index = 0; index < count && valid; ++index)
+      {
+        uint64_t id;
+        valid = get(id) && get(value);
+        record.machines[index] = static_cast<MachineId>(id);
+        record.roundTrips[index] = static_cast<Poco::Timestamp::TimeDiff>(value) - 1;
+      }
+      break;
+    }
+
+    case TraceRecordSeen:
+    case TraceRecordLost:
+      valid = get(record.sighting.mac, sizeof(record.sighting.mac)) &&
+              get(reinterpret_cast<uint8_t*>(&record.sighting.ip), sizeof(record.sighting.ip));
+      break;
+
+    case TraceRecordAlwaysOn:
+      valid = get(&record.value, 1);
+      break;
+
+    case TraceRecordManualWake:
+    case TraceRecordManualShutdown:
+    case TraceRecordHold:
+      valid = get(record.name) && get(&record.value, 1);
+      break;
+
+    case TraceRecordWake:
+    case TraceRecordShutdown:
+    case TraceRecordShutdownFinished:
+    {
+      uint64_t id;
+      valid = get(id) && get(&record.value, 1);
+      record.server = static_cast<MachineId>(id);
+      break;
+    }
+
+    default:
+      valid = false;
+      break;
+  }
+
+  if (!valid)
+  {
+    m_position = start;
+    return false;
+  }
+
+  m_time = time;
+  record.time = Poco::Timestamp(time);
+  return true;
+}
+
+bool TraceReader::get(uint64_t& value)
+{
+  value = 0;
+  for (unsigned int shift = 0; m_position < m_size && shift < 64; shift += 7)
+  {
+    const uint8_t byte = m_data[m_position++];
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+bool TraceReader::get(std::string& value)
+{
+  uint64_t size;
+  if (!get(size) || size > m_size - m_position)
+    return false;
+
+  value.assign(reinterpret_cast<const char*>(m_data + m_position), static_cast<size_t>(size));
+  m_position += static_cast<size_t>(size);
+  return true;
+}
+
+bool TraceReader::get(uint8_t* data, size_t size)
+{
+  if (size > m_size - m_position)
+    return false;
+
+  memcpy(data, m_data + m_position, size);
+  m_position += size;
+  return true;
+}
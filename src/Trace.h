@@ -0,0 +1,157 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <Poco/Timestamp.h>
+
+#include "MachineSet.h"
+#include "Sighting.h"
+
+class MachineRegistry;
+
+// a trace file starts with an 8 byte magic and a 32 bit version followed by
+// records of a type byte, the time in microseconds since the previous record
+// and the payload of the type, all integers except for the ones in the
+// header and sightings are unsigned LEB128 varints
+typedef enum TraceRecordType
+{
+  TraceRecordInvalid = 0,
+  // a new session of the daemon, the time is the wall clock time in
+  // microseconds since the epoch from which all following records count on
+  TraceRecordStart,
+  // names and state of all servers and machines by their identifier
+  TraceRecordMachines,
+  // identifier and round trip time plus one (zero if there was no reply) of
+  // every machine which has been probed
+  TraceRecordRound,
+  // MAC and IP address of a machine which has been seen or lost passively
+  TraceRecordSeen,
+  TraceRecordLost,
+  TraceRecordExpire,
+  TraceRecordDecide,
+  TraceRecordAlwaysOn,
+  // manual actions with the name of the server they apply to
+  TraceRecordManualWake,
+  TraceRecordManualShutdown,
+  TraceRecordHold,
+  // actions taken for the server with the given identifier
+  TraceRecordWake,
+  TraceRecordShutdown,
+  TraceRecordShutdownFinished
+} TraceRecordType;
+
+typedef struct TraceRecord
+{
+  TraceRecordType type;
+  Poco::Timestamp time;
+
+  // TraceRecordMachines
+  size_t servers;
+  std::vector<std::string> names;
+  std::vector<uint8_t> online;
+  std::vector<Poco::Timestamp> lastSeen;
+  std::vector<Poco::Timestamp> lastChange;
+
+  // TraceRecordRound
+  std::vector<MachineId> machines;
+  std::vector<Poco::Timestamp::TimeDiff> roundTrips;
+
+  // TraceRecordSeen and TraceRecordLost
+  Sighting sighting;
+
+  // TraceRecordManual*, TraceRecordHold and the server actions
+  std::string name;
+  MachineId server;
+  // always on, the kind of hold or the outcome of a shutdown
+  uint8_t value;
+} TraceRecord;
+
+// appends a compact binary record of everything the decisions are based on
+// and of the actions taken to a file, the records are buffered and written
+// out when Flush() is called or the buffer is full
+class TraceWriter
+{
+  public:
+    TraceWriter();
+    ~TraceWriter();
+
+    bool Open(const std::string& path);
+    bool IsOpen() const { return m_file >= 0; }
+    void Close();
+
+    void WriteMachines(const MachineRegistry& registry, const std::vector<Poco::Timestamp>& lastChanges);
+    void WriteRound(const std::vector<MachineId>& machines, const std::vector<Poco::Timestamp::TimeDiff>& roundTrips);
+    void WriteSighting(TraceRecordType type, const Sighting& sighting);
+    void WriteEvent(TraceRecordType type);
+    void WriteValue(TraceRecordType type, uint8_t value);
+    void WriteManual(TraceRecordType type, const std::string& name, uint8_t value = 0);
+    void WriteAction(TraceRecordType type, MachineId server, uint8_t value = 0);
+
+    void Flush();
+
+  private:
+    TraceWriter(const TraceWriter&);
+    TraceWriter& operator=(const TraceWriter&);
+
+    void begin(TraceRecordType type);
+    void put(uint64_t value);
+    void put(const std::string& value);
+    void end();
+
+    std::string m_path;
+    int m_file;
+    std::vector<uint8_t> m_buffer;
+    int64_t m_last;
+};
+
+// reads the records of a trace file written by TraceWriter
+class TraceReader
+{
+  public:
+    TraceReader();
+    ~TraceReader();
+
+    bool Open(const std::string& path);
+    void Close();
+
+    // reads the next record, returns false at the end of the file or if the
+    // rest of it is invalid (e.g. a record cut off by a crash)
+    bool Next(TraceRecord& record);
+    bool IsTruncated() const { return m_position < m_size; }
+
+  private:
+    TraceReader(const TraceReader&);
+    TraceReader& operator=(const TraceReader&);
+
+    bool get(uint64_t& value);
+    bool get(std::string& value);
+    bool get(uint8_t* data, size_t size);
+
+    int m_file;
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_position;
+    Poco::Timestamp::TimeVal m_time;
+};
+
@@ -0,0 +1,392 @@
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <map>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include <log4cxx/logger.h>
+
+#include "Backend.h"
+#include "Clock.h"
+#include "Configuration.h"
+#include "Machine.h"
+#include "MachineRegistry.h"
+#include "Metrics.h"
+#include "Monitor.h"
+#include "ShutdownExecutor.h"
+#include "Trace.h"
+#include "TraceReplay.h"
+
+#define SECONDS_TO_MICROSECONDS 1000000
+
+#define NO_MACHINE              static_cast<MachineId>(-1)
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("TraceReplay"));
+
+typedef struct TraceAction
+{
+  TraceRecordType type;
+  std::string server;
+  Poco::Timestamp time;
+} TraceAction;
+
+// answers probes with the results of the recorded round and notes down every
+// action instead of carrying it out
+class ReplayBackend : public Backend
+{
+  public:
+    ReplayBackend()
+      : m_results(),
+        m_roundTrips(),
+        m_shutdowns(),
+        m_actions()
+    { }
+
+    // round trip times of the next probe round by identifier, -1 if there
+    // hasn't been a reply
+    std::vector<Poco::Timestamp::TimeDiff>& GetResults() { return m_results; }
+
+    // hands the recorded outcome of a shutdown to the executor shutting down
+    // the server with the given name
+    void Finish(const std::string& server, bool success)
+    {
+      std::map<std::string, std::pair<bool, bool> >::iterator shutdown = m_shutdowns.find(server);
+      if (shutdown != m_shutdowns.end())
+        shutdown->second = std::make_pair(true, success);
+    }
+
+    const std::vector<TraceAction>& GetActions() const { return m_actions; }
+
+    virtual size_t Ping(const MachineRegistry& registry, const std::vector<MachineId>& machines, uint8_t timeout,
+                        MachineSet& available, PingObserver* observer)
+    {
+      available.Reset(registry.GetSize());
+      m_roundTrips.assign(machines.size(), -1);
+
+      size_t replies = 0;
+      for (size_t index = 0; index < machines.size(); ++index)
+      {
+        if (machines[index] >= m_results.size() || m_results[machines[index]] < 0)
+          continue;
+
+        available.Set(machines[index]);
+        m_roundTrips[index] = m_results[machines[index]];
+        ++replies;
+        if (observer != NULL && observer->Replied(index))
+          break;
+      }
+
+      return replies;
+    }
+    virtual const std::vector<Poco::Timestamp::TimeDiff>& GetRoundTrips() const { return m_roundTrips; }
+    // the trace only records the replies so every probe counts as sent
+    virtual size_t GetSent() const { return m_roundTrips.size(); }
+
+    virtual bool Wake(const Machine& machine)
+    {
+      addAction(TraceRecordWake, machine.GetName());
+      return true;
+    }
+
+    virtual bool Shutdown(const Machine& machine, uint16_t connectTimeout, uint16_t executeTimeout)
+    {
+      addAction(TraceRecordShutdown, machine.GetName());
+      return true;
+    }
+
+    virtual ShutdownExecutor* CreateShutdownExecutor(uint16_t connectTimeout, uint16_t executeTimeout);
+
+    // called by the executors
+    void Started(const std::string& server)
+    {
+      m_shutdowns[server] = std::make_pair(false, false);
+      addAction(TraceRecordShutdown, server);
+    }
+
+    bool GetResult(const std::string& server, bool& success)
+    {
+      std::map<std::string, std::pair<bool, bool> >::iterator shutdown = m_shutdowns.find(server);
+      if (shutdown == m_shutdowns.end() || !shutdown->second.first)
+        return false;
+
+      success = shutdown->second.second;
+      m_shutdowns.erase(shutdown);
+      return true;
+    }
+
+  private:
+    ReplayBackend(const ReplayBackend&);
+    ReplayBackend& operator=(const ReplayBackend&);
+
+    void addAction(TraceRecordType type, const std::string& server)
+    {
+      TraceAction action;
+      action.type = type;
+      action.server = server;
+      action.time = Clock::Now();
+      m_actions.push_back(action);
+    }
+
+    std::vector<Poco::Timestamp::TimeDiff> m_results;
+    std::vector<Poco::Timestamp::TimeDiff> m_roundTrips;
+    // whether the outcome is known and whether it has been successful by the
+    // name of the server being shut down
+    std::map<std::string, std::pair<bool, bool> > m_shutdowns;
+    std::vector<TraceAction> m_actions;
+};
+
+// a shutdown is in progress until its recorded outcome shows up in the trace
+class ReplayShutdownExecutor : public ShutdownExecutor
+{
+  public:
+    ReplayShutdownExecutor(ReplayBackend& backend)
+      : m_backend(backend),
+        m_server(),
+        m_busy(false)
+    { }
+
+    virtual bool Start() { return true; }
+    virtual void Stop() { }
+    virtual int GetDescriptor() const { return -1; }
+    virtual void SetOnline(const Machine& machine, bool online) { }
+
+    virtual bool Shutdown(const Machine& machine)
+    {
+      if (m_busy)
+        return false;
+
+      m_server = machine.GetName();
+      m_busy = true;
+      m_backend.Started(m_server);
+      return true;
+    }
+    virtual bool IsBusy() const { return m_busy; }
+
+    virtual bool GetResult(bool& success)
+    {
+      if (!m_busy || !m_backend.GetResult(m_server, success))
+        return false;
+
+      m_busy = false;
+      return true;
+    }
+
+  private:
+    ReplayBackend& m_backend;
+    std::string m_server;
+    bool m_busy;
+};
+
+ShutdownExecutor* ReplayBackend::CreateShutdownExecutor(uint16_t connectTimeout, uint16_t executeTimeout)
+{
+  return new ReplayShutdownExecutor(*this);
+}
+
+static const char* describe(TraceRecordType type)
+{
+  return type == TraceRecordWake ? "wake up" : "shut down";
+}
+
+TraceReplay::TraceReplay(Configuration& config)
+  : m_config(config)
+{ }
+
+bool TraceReplay::Run(const std::string& path, std::ostream& output)
+{
+  TraceReader reader;
+  if (!reader.Open(path))
+  {
+    output << "Failed to read the trace " << path << "\n";
+    return false;
+  }
+
+  Clock::SetVirtual(Poco::Timestamp(0));
+
+  ReplayBackend backend;
+  Metrics metrics;
+  Monitor monitor(m_config, backend, metrics);
+  if (!monitor.Start())
+    return false;
+
+  // the servers come first in the registry just like in the trace
+  const MachineRegistry& registry = monitor.GetRegistry();
+  const size_t servers = m_config.GetServers().size();
+  std::map<std::string, MachineId> machineIds[2];
+  for (MachineId id = 0; id < registry.GetSize(); ++id)
+    machineIds[id < servers ? 0 : 1][registry.GetMachine(id).GetName()] = id;
+
+  // recorded identifiers and names of the current session
+  std::vector<MachineId> ids;
+  std::vector<std::string> names;
+  std::vector<TraceAction> recorded;
+
+  uint64_t records = 0, sessions = 0, rounds = 0, decisions = 0;
+  Poco::Timestamp first(0), last(0);
+  std::ostringstream discarded;
+  TraceRecord record;
+  Poco::Timestamp start;
+  while (reader.Next(record))
+  {
+    ++records;
+    if (records == 1)
+      first = record.time;
+    last = record.time;
+    Clock::SetVirtual(record.time);
+
+    switch (record.type)
+    {
+      case TraceRecordStart:
+        // a restarted daemon neither remembers holds nor always on
+        ++sessions;
+        ids.clear();
+        names.clear();
+        monitor.SetHold("", HoldNone, discarded);
+        monitor.SetAlwaysOn(false);
+        break;
+
+      case TraceRecordMachines:
+        names = record.names;
+        ids.assign(names.size(), NO_MACHINE);
+        for (size_t index = 0; index < names.size(); ++index)
+        {
+          const bool server = index < record.servers;
+          std::map<std::string, MachineId>::const_iterator id = machineIds[server ? 0 : 1].find(names[index]);
+          if (id == machineIds[server ? 0 : 1].end())
+            continue;
+
+          ids[index] = id->second;
+          monitor.Restore(names[index], server, record.online[index] != 0, record.lastSeen[index],
+                          server ? record.lastChange[index] : Poco::Timestamp(0));
+        }
+        break;
+
+      case TraceRecordRound:
+      {
+        std::vector<Poco::Timestamp::TimeDiff>& results = backend.GetResults();
+        results.assign(registry.GetSize(), -1);
+        for (size_t index = 0; index < record.machines.size(); ++index)
+        {
+          if (record.machines[index] < ids.size() && ids[record.machines[index]] != NO_MACHINE)
+            results[ids[record.machines[index]]] = record.roundTrips[index];
+        }
+
+        // machines which haven't been probed in the recording count as not
+        // having replied which only matters once they time out anyway
+        monitor.Probe(true);
+        ++rounds;
+        break;
+      }
+
+      case TraceRecordSeen:
+        monitor.Seen(record.sighting);
+        break;
+
+      case TraceRecordLost:
+        monitor.Lost(record.sighting);
+        break;
+
+      case TraceRecordExpire:
+        monitor.Expire();
+        break;
+
+      case TraceRecordDecide:
+        monitor.Decide();
+        ++decisions;
+        break;
+
+      case TraceRecordAlwaysOn:
+        monitor.SetAlwaysOn(record.value != 0);
+        break;
+
+      case TraceRecordManualWake:
+        monitor.Wake(record.name, discarded);
+        break;
+
+      case TraceRecordManualShutdown:
+        monitor.Shutdown(record.name, discarded);
+        break;
+
+      case TraceRecordHold:
+        monitor.SetHold(record.name, static_cast<Hold>(record.value), discarded);
+        break;
+
+      case TraceRecordWake:
+      case TraceRecordShutdown:
+        if (record.server < names.size())
+        {
+          TraceAction action;
+          action.type = record.type;
+          action.server = names[record.server];
+          action.time = record.time;
+          recorded.push_back(action);
+        }
+        break;
+
+      case TraceRecordShutdownFinished:
+        if (record.server < names.size())
+          backend.Finish(names[record.server], record.value != 0);
+        monitor.ShutdownFinished();
+        break;
+
+      default:
+        break;
+    }
+
+    discarded.str("");
+  }
+  const Poco::Timestamp::TimeDiff elapsed = start.elapsed();
+
+  if (reader.IsTruncated())
+    LOG4CXX_WARN(logger, "Ignoring the invalid end of " << path);
+
+  output << "Replayed " << records << " records of " << sessions << " sessions covering "
+         << (last - first) / SECONDS_TO_MICROSECONDS << "s in " << elapsed / 1000 << "ms";
+  if (elapsed > 0)
+    output << " (" << records * SECONDS_TO_MICROSECONDS / static_cast<uint64_t>(elapsed) << " records/s)";
+  output << "\n";
+  output << "\tProbe rounds: " << rounds << "\n";
+  output << "\tDecisions: " << decisions << "\n";
+
+  // the actions are compared in order, the first difference is reported
+  const std::vector<TraceAction>& replayed = backend.GetActions();
+  output << "\tRecorded actions: " << recorded.size() << "\n";
+  output << "\tReplayed actions: " << replayed.size() << "\n";
+
+  size_t index = 0;
+  while (index < recorded.size() && index < replayed.size() &&
+         recorded[index].type == replayed[index].type && recorded[index].server == replayed[index].server)
+    ++index;
+
+  if (index == recorded.size() && index == replayed.size())
+  {
+    output << "The decisions match the trace\n";
+    return true;
+  }
+
+  output << "The decisions differ from the trace after " << index << " actions:\n";
+  if (index < recorded.size())
+    output << "\tRecorded: " << describe(recorded[index].type) << " " << recorded[index].server
+           << " at " << (recorded[index].time - first) / SECONDS_TO_MICROSECONDS << "s\n";
+  if (index < replayed.size())
+    output << "\tReplayed: " << describe(replayed[index].type) << " " << replayed[index].server
+           << " at " << (replayed[index].time - first) / SECONDS_TO_MICROSECONDS << "s\n";
+  return false;
+}
@@ -0,0 +1,44 @@
+#pragma once
+/*
+ *  Copyright (C) 2015 Sascha Montellese <sascha.montellese@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <ostream>
+#include <string>
+
+class Configuration;
+
+// feeds a trace recorded by the daemon through the decisions of a monitor
+// for the given configuration as fast as possible and compares the actions
+// it takes with the recorded ones, configuration reloads in the trace only
+// change which machines the recorded identifiers refer to
+class TraceReplay
+{
+  public:
+    TraceReplay(Configuration& config);
+
+    // returns false if the trace couldn't be read or the actions differ
+    bool Run(const std::string& path, std::ostream& output);
+
+  private:
+    TraceReplay(const TraceReplay&);
+    TraceReplay& operator=(const TraceReplay&);
+
+    Configuration& m_config;
+};
+
@@ -19,6 +19,7 @@
 
 #include <fstream>
 #include <iostream>
+#include <sstream>
 
 #include <log4cxx/logger.h>
 #include <log4cxx/basicconfigurator.h>
@@ -28,21 +29,40 @@
 #include <log4cxx/helpers/exception.h>
 
 #include <Poco/File.h>
+#include <Poco/NumberFormatter.h>
 #include <Poco/Path.h>
 
 #include <signal.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "AsyncFileAppender.h"
 #include "Configuration.h"
+#include "ControlSocket.h"
+#include "Discovery.h"
+#include "EventLoop.h"
+#include "FileWatcher.h"
+#include "Metrics.h"
+#include "MetricsServer.h"
+#include "Monitor.h"
+#include "NeighbourMonitor.h"
+#include "NetworkGroup.h"
 #include "Networking.h"
+#include "Server.h"
+#include "SignalWatcher.h"
+#include "Sniffer.h"
+#include "Timer.h"
+#include "TraceReplay.h"
 
 #define APPLICATION             "home-monitor"
 
 #define LOGGING_PATH            "/var/log/" APPLICATION
 #define CONFIGURATION_PATH      "/etc/opt/" APPLICATION
 #define CONFIGURATION_FILENAME  APPLICATION ".xml"
-
-#define CHANGE_TIMEOUT          120
+#define CONTROL_PATH            "/var/run/" APPLICATION ".sock"
+// how long a client waits for the daemon to answer (in milliseconds), the
+// daemon only answers in between probe rounds and discovery sweeps
+#define CONTROL_TIMEOUT         10000
 
 #define SECONDS_TO_MICROSECONDS 1000000
 
@@ -55,47 +75,213 @@ typedef enum ManualMode
 {
   ManualModeNone = 0,
   ManualModeWakeup,
-  ManualModeShutdown
+  ManualModeShutdown,
+  ManualModeStatus,
+  ManualModeProbe,
+  ManualModeHoldOn,
+  ManualModeHoldOff,
+  ManualModeRelease
 } ManualMode;
 
-static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger(APPLICATION));
+// commands understood by the control socket in the order of ManualMode
+static const char* ControlCommands[] = { "", "wake", "shutdown", "status", "probe", "hold-on", "hold-off", "release" };
+
+typedef enum Event
+{
+  EventSignal = 0,
+  EventPing,
+  EventDeadline,
+  EventAlwaysOn,
+  EventSniffer,
+  EventNeighbours,
+  EventShutdown,
+  EventConfiguration,
+  EventControl,
+  EventDiscovery,
+  EventDiscoverySweep
+} Event;
 
-static bool abortRequested = false;
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger(APPLICATION));
 
-static void signalHandler(int signal)
+static bool handleSignal(int signal, bool& reload)
 {
   switch (signal)
   {
+    case SIGHUP:
+      LOG4CXX_INFO(logger, "Received SIGHUP --> reloading the configuration...");
+      reload = true;
+      break;
+
     case SIGTERM:
       LOG4CXX_INFO(logger, "Received SIGTERM --> terminating...");
-      abortRequested = true;
-      break;
+      return true;
 
     case SIGINT:
       LOG4CXX_INFO(logger, "Received SIGINT --> terminating...");
-      abortRequested = true;
-      break;
+      return true;
 
     default:
       LOG4CXX_WARN(logger, "Received signal " << signal);
       break;
   }
+
+  return false;
+}
+
+// writes out whatever the asynchronous appender still holds
+static void stopLogging()
+{
+  log4cxx::Logger::getRootLogger()->removeAllAppenders();
+}
+
+static std::string probeDescription(const Machine& machine)
+{
+  std::string description;
+  switch (machine.GetProbe())
+  {
+    case ProbeTypeArp:
+      description = ", ARP";
+      break;
+
+    case ProbeTypeTcp:
+      description = ", TCP port " + Poco::NumberFormatter::format(machine.GetPort());
+      break;
+
+    case ProbeTypeIcmp6:
+      description = ", ICMPv6";
+      break;
+
+    case ProbeTypeNdp:
+      description = ", NDP";
+      break;
+
+    case ProbeTypeIcmp:
+    default:
+      break;
+  }
+
+  if (!machine.GetIpv6Address().empty())
+    description += " " + machine.GetIpv6Address();
+  if (!machine.GetInterface().empty())
+    description += ", on " + machine.GetInterface();
+
+  return description;
+}
+
+// loads the configuration again and hands it over to the monitor, settings
+// which need the network or files to be reopened require a restart
+static bool reloadConfiguration(const std::string& location, Configuration& config, Monitor& monitor, NetworkGroup& network)
+{
+  LOG4CXX_INFO(logger, "Reading configuration from " << location << "...");
+  Configuration reloaded;
+  if (!reloaded.Load(location) || reloaded.GetMachines().empty())
+  {
+    LOG4CXX_ERROR(logger, "Invalid configuration file at " << location << ", keeping the current configuration");
+    return false;
+  }
+
+  if (reloaded.GetNetworkInterfaces() != config.GetNetworkInterfaces() ||
+      reloaded.IsNetworkPassive() != config.IsNetworkPassive() ||
+      reloaded.IsNetworkNeighbours() != config.IsNetworkNeighbours() ||
+      (reloaded.GetDiscoveryInterval() == 0) != (config.GetDiscoveryInterval() == 0) ||
+      reloaded.IsLoggingAsync() != config.IsLoggingAsync() ||
+      reloaded.GetLoggingBuffer() != config.GetLoggingBuffer() ||
+      reloaded.GetLoggingOverflow() != config.GetLoggingOverflow() ||
+      reloaded.GetAlwaysOnFile() != config.GetAlwaysOnFile() ||
+      reloaded.GetStateFile() != config.GetStateFile() ||
+      reloaded.GetTraceFile() != config.GetTraceFile())
+  {
+    LOG4CXX_ERROR(logger, "Changes to the network, log file or files settings require a restart, keeping the current configuration");
+    return false;
+  }
+
+  log4cxx::LayoutPtr loggingLayout(new log4cxx::PatternLayout(reloaded.GetLoggingPattern()));
+  log4cxx::Logger::getRootLogger()->getAppender(APPLICATION)->setLayout(loggingLayout);
+  log4cxx::Logger::getRootLogger()->setLevel(log4cxx::Level::toLevel(reloaded.GetLoggingLevel()));
+
+  network.SetWakeBurst(reloaded.GetWakeBurst(), reloaded.IsWakeUdp());
+  monitor.Reload(reloaded);
+  config = reloaded;
+  return true;
+}
+
+// starts sweeping the subnets unless the previous sweep is still running,
+// the replies re-bind the machines to their current IP address
+static void discover(Discovery& discovery, const Configuration& config)
+{
+  if (discovery.IsSweeping())
+    LOG4CXX_WARN(logger, "The previous discovery is still running, consider a higher <discovery><rate> or a longer <discovery><interval>");
+  else if (!discovery.Start(config.GetDiscoveryRate()))
+    LOG4CXX_WARN(logger, "Failed to start the discovery");
+}
+
+// executes a command received through the control socket, the first line of
+// the response is either OK or ERROR followed by a description
+static std::string handleCommand(const std::string& command, Monitor& monitor, bool& probe)
+{
+  std::string name = command;
+  std::string argument;
+  size_t separator = command.find(' ');
+  if (separator != std::string::npos)
+  {
+    name = command.substr(0, separator);
+    argument = command.substr(separator + 1);
+  }
+
+  LOG4CXX_DEBUG(logger, "Received command \"" << command << "\"");
+
+  std::ostringstream output;
+  bool success = true;
+  if (name == ControlCommands[ManualModeWakeup])
+    success = monitor.Wake(argument, output);
+  else if (name == ControlCommands[ManualModeShutdown])
+    success = monitor.Shutdown(argument, output);
+  else if (name == ControlCommands[ManualModeStatus])
+    monitor.WriteStatus(output);
+  else if (name == ControlCommands[ManualModeProbe])
+  {
+    // the probe round only starts once the client has been answered
+    probe = true;
+    output << "Probing all servers and machines\n";
+  }
+  else if (name == ControlCommands[ManualModeHoldOn])
+    success = monitor.SetHold(argument, HoldOn, output);
+  else if (name == ControlCommands[ManualModeHoldOff])
+    success = monitor.SetHold(argument, HoldOff, output);
+  else if (name == ControlCommands[ManualModeRelease])
+    success = monitor.SetHold(argument, HoldNone, output);
+  else
+  {
+    output << "Unknown command " << name << "\n";
+    success = false;
+  }
+
+  return (success ? "OK\n" : "ERROR\n") + output.str();
 }
 
 void printUsage()
 {
   cout << APPLICATION " [OPTION]" << endl;
   cout << "\t-v, --verbose\tLog to standard output." << endl;
-  cout << "\t-s, --shutdown\tShut the server down." << endl;
-  cout << "\t-w, --wake\tWake the server up." << endl;
+  cout << "\t-s, --shutdown [SERVER]\tShut the given or all servers down." << endl;
+  cout << "\t-w, --wake [SERVER]\tWake the given or all servers up." << endl;
+  cout << "\t--status\tShow the state of all servers and machines." << endl;
+  cout << "\t--probe\tProbe all servers and machines right away." << endl;
+  cout << "\t--hold-on [SERVER]\tKeep the given or all servers on." << endl;
+  cout << "\t--hold-off [SERVER]\tKeep the given or all servers off." << endl;
+  cout << "\t--release [SERVER]\tLet the given or all servers be woken up and shut down automatically again." << endl;
+  cout << "\t--replay TRACE\tFeed a recorded trace through the decisions and compare the actions." << endl;
   cout << endl;
   cout << "Passing no option starts the daemon mode which monitors the network for activity of certain machines and either wakes the server up or shuts it down." << endl;
+  cout << "All other options are passed on to the running daemon. Waking up or shutting down servers falls back to doing it directly if the daemon isn't running." << endl;
 }
 
 int main(int argc, char** argv)
 {
   bool verboseLogging = false;
   ManualMode manualMode = ManualModeNone;
+  std::string manualServer;
+  std::string replayTrace;
 
   // parse any command line options
   for (int argIndex = 1; argIndex < argc; ++argIndex)
@@ -113,18 +299,80 @@ int main(int argc, char** argv)
       manualMode = ManualModeShutdown;
     else if (arg.compare("-w") == 0 || arg.compare("--wakeup") == 0)
       manualMode = ManualModeWakeup;
+    else if (arg.compare("--status") == 0)
+      manualMode = ManualModeStatus;
+    else if (arg.compare("--probe") == 0)
+      manualMode = ManualModeProbe;
+    else if (arg.compare("--hold-on") == 0)
+      manualMode = ManualModeHoldOn;
+    else if (arg.compare("--hold-off") == 0)
+      manualMode = ManualModeHoldOff;
+    else if (arg.compare("--release") == 0)
+      manualMode = ManualModeRelease;
+    else if (arg.compare("--replay") == 0 && argIndex + 1 < argc && argv[argIndex + 1] != NULL)
+      replayTrace = argv[++argIndex];
     else
     {
       printUsage();
       return 4;
     }
+
+    // an optional server name may follow the manual action
+    if (manualMode != ManualModeNone && manualMode != ManualModeStatus && manualMode != ManualModeProbe && manualServer.empty() &&
+        argIndex + 1 < argc && argv[argIndex + 1] != NULL && argv[argIndex + 1][0] != '-')
+      manualServer = argv[++argIndex];
+  }
+
+  // manual actions are carried out by the running daemon so that it knows
+  // about them
+  if (manualMode != ManualModeNone)
+  {
+    std::string command = ControlCommands[manualMode];
+    if (!manualServer.empty())
+      command += " " + manualServer;
+
+    std::string response;
+    ControlResult result = ControlSocket::Send(CONTROL_PATH, command, response, CONTROL_TIMEOUT);
+    if (result == ControlResultAnswered)
+    {
+      size_t body = response.find('\n');
+      if (body != std::string::npos)
+        cout << response.substr(body + 1) << flush;
+      return response.compare(0, 2, "OK") == 0 ? 0 : 5;
+    }
+
+    // a busy daemon might still carry out the command later, acting directly
+    // as well could wake or shut down a server twice
+    if (result == ControlResultTimeout)
+    {
+      cout << APPLICATION " didn't answer in time" << endl;
+      return 5;
+    }
+    if (result == ControlResultDenied)
+    {
+      cout << "Permission denied to control " APPLICATION " through " CONTROL_PATH << endl;
+      return 5;
+    }
+    if (result == ControlResultFailed)
+    {
+      cout << "Failed to control " APPLICATION ": " << strerror(errno) << endl;
+      return 5;
+    }
+
+    if (manualMode != ManualModeWakeup && manualMode != ManualModeShutdown)
+    {
+      cout << APPLICATION " is not running" << endl;
+      return 5;
+    }
+
+    cout << APPLICATION " is not running, acting directly" << endl;
   }
 
   Configuration config;
 
   // setup log4cxx logging
   log4cxx::LayoutPtr loggingLayout(new log4cxx::PatternLayout(config.GetLoggingPattern()));
-  log4cxx::AppenderPtr loggingAppender(verboseLogging ?
+  log4cxx::AppenderPtr loggingAppender(verboseLogging || !replayTrace.empty() ?
     static_cast<log4cxx::Appender*>(new log4cxx::ConsoleAppender(loggingLayout)) :
     static_cast<log4cxx::Appender*>(new log4cxx::FileAppender(loggingLayout, LOGGING_PATH, true)));
   loggingAppender->setName(APPLICATION);
@@ -171,66 +419,129 @@ int main(int argc, char** argv)
   log4cxx::Logger::getRootLogger()->getAppender(APPLICATION)->setLayout(loggingLayout);
   log4cxx::Logger::getRootLogger()->setLevel(log4cxx::Level::toLevel(config.GetLoggingLevel()));
 
-  Networking network(config.GetNetworkInterface());
-  if (network.GetInterface().empty() ||
-      network.GetIpAddress().empty() ||
-      network.GetMacAddress().empty())
+  // the log file on the SD card is written by a background thread so that
+  // the monitor never waits for it
+  if (config.IsLoggingAsync() && !verboseLogging && replayTrace.empty())
   {
-    LOG4CXX_FATAL(logger, "Invalid network configuration!");
-    return 3;
+    AsyncFileAppender* asyncAppender = new AsyncFileAppender(loggingLayout, LOGGING_PATH, config.GetLoggingBuffer(), config.GetLoggingOverflow());
+    log4cxx::AppenderPtr appender(asyncAppender);
+    if (asyncAppender->IsOpen())
+    {
+      asyncAppender->setName(APPLICATION);
+      log4cxx::Logger::getRootLogger()->removeAllAppenders();
+      log4cxx::Logger::getRootLogger()->addAppender(appender);
+      atexit(stopLogging);
+    }
+    else
+      LOG4CXX_WARN(logger, "Failed to log asynchronously to " << LOGGING_PATH);
   }
 
-  LOG4CXX_INFO(logger, "Network");
-  LOG4CXX_INFO(logger, "\tInterface: " << network.GetInterface());
-  LOG4CXX_INFO(logger, "\tMAC address: " << network.GetMacAddress());
-  LOG4CXX_INFO(logger, "\tIP address: " << network.GetIpAddress());
-  LOG4CXX_INFO(logger, "");
+  // replaying a trace only needs the configuration, unless asked for only
+  // problems are logged so that the replay runs as fast as possible
+  if (!replayTrace.empty())
+  {
+    if (!verboseLogging)
+      log4cxx::Logger::getRootLogger()->setLevel(log4cxx::Level::getWarn());
 
-  Machine& server = config.GetServer();
-  LOG4CXX_INFO(logger, "Server");
-  LOG4CXX_INFO(logger, "\t" << server.GetName() << " (" << server.GetUsername() << "): " << server.GetMacAddress() << " / " << server.GetIpAddress());
-  LOG4CXX_INFO(logger, "");
+    TraceReplay replay(config);
+    return replay.Run(replayTrace, cout) ? 0 : 5;
+  }
 
-  // check if an option has been provided
-  if (manualMode == ManualModeWakeup)
+  // every interface machines are bound to is probed on its own
+  NetworkGroup network;
+  const std::vector<std::string> interfaces = config.GetNetworkInterfaces();
+  for (std::vector<std::string>::const_iterator interface = interfaces.begin(); interface != interfaces.end(); ++interface)
   {
-    cout << "Waking up " << server.GetName() << "... " << flush;
-    if (network.Wake(server))
+    if (network.Add(*interface) == NULL)
     {
-      cout << "working" << endl;
-      return 0;
-    }
-    else
-    {
-      cout << "failed" << endl;
-      return 5;
+      LOG4CXX_FATAL(logger, "Invalid network configuration for " << *interface << "!");
+      return 3;
     }
   }
-  else if (manualMode == ManualModeShutdown)
+
+  network.SetWakeBurst(config.GetWakeBurst(), config.IsWakeUdp());
+
+  LOG4CXX_INFO(logger, "Network");
+  for (size_t index = 0; index < network.GetSize(); ++index)
   {
-    cout << "Shutting down " << server.GetName() << "... " << flush;
-    if (network.Shutdown(server))
+    const Networking& networking = network.GetNetworking(index);
+    LOG4CXX_INFO(logger, "\tInterface: " << networking.GetInterface() << " (" << networking.GetMacAddress() << " / " << networking.GetIpAddress() << ")");
+  }
+  LOG4CXX_INFO(logger, "\tPassive: " << (config.IsNetworkPassive() ? "yes" : "no"));
+  LOG4CXX_INFO(logger, "\tNeighbours: " << (config.IsNetworkNeighbours() ? "yes" : "no"));
+  if (config.GetDiscoveryInterval() > 0) {
+    LOG4CXX_INFO(logger, "\tDiscovery: every " << config.GetDiscoveryInterval() << "s at " << config.GetDiscoveryRate() << " requests/s");
+  } else {
+    LOG4CXX_INFO(logger, "\tDiscovery: no");
+  }
+  LOG4CXX_INFO(logger, "");
+
+  std::vector<Server>& servers = config.GetServers();
+  LOG4CXX_INFO(logger, "Servers (" << servers.size() << ")");
+  for (std::vector<Server>::const_iterator server = servers.begin(); server != servers.end(); ++server)
+  {
+    const Machine& machine = server->GetMachine();
+    LOG4CXX_INFO(logger, "\t" << machine.GetName() << " (" << machine.GetUsername() << "): " << machine.GetMacAddress() << " / " << machine.GetIpAddress() << probeDescription(machine));
+    for (std::vector<size_t>::const_iterator client = server->GetClients().begin(); client != server->GetClients().end(); ++client)
+      LOG4CXX_INFO(logger, "\t\t" << config.GetMachines()[*client].GetName());
+  }
+  LOG4CXX_INFO(logger, "");
+
+  // check if an option has been provided
+  if (manualMode != ManualModeNone)
+  {
+    bool found = false;
+    bool failed = false;
+    for (std::vector<Server>::const_iterator server = servers.begin(); server != servers.end(); ++server)
     {
-      cout << "working" << endl;
-      return 0;
+      const Machine& machine = server->GetMachine();
+      if (!manualServer.empty() && machine.GetName() != manualServer)
+        continue;
+
+      found = true;
+      bool success;
+      if (manualMode == ManualModeWakeup)
+      {
+        cout << "Waking up " << machine.GetName() << "... " << flush;
+        success = network.Wake(machine);
+      }
+      else
+      {
+        cout << "Shutting down " << machine.GetName() << "... " << flush;
+        success = network.Shutdown(machine, config.GetSshConnectTimeout(), config.GetSshExecuteTimeout());
+      }
+
+      if (success)
+        cout << "working" << endl;
+      else
+      {
+        cout << "failed" << endl;
+        failed = true;
+      }
     }
-    else
+
+    if (!found)
     {
-      cout << "failed" << endl;
-      return 5;
+      cout << "Unknown server " << manualServer << endl;
+      return 4;
     }
+
+    return failed ? 5 : 0;
   }
 
   LOG4CXX_INFO(logger, "Ping");
   LOG4CXX_INFO(logger, "\tInterval: " << config.GetPingInterval());
+  LOG4CXX_INFO(logger, "\tOffline interval: " << config.GetPingOfflineInterval());
+  LOG4CXX_INFO(logger, "\tEarly exit: " << (config.IsPingEarlyExit() ? "yes" : "no"));
   LOG4CXX_INFO(logger, "\tTimeout: " << static_cast<uint32_t>(config.GetPingTimeout()));
   LOG4CXX_INFO(logger, "");
 
-  struct sigaction action;
-  memset(&action, 0, sizeof(struct sigaction));
-  action.sa_handler = signalHandler;
-  sigaction(SIGTERM, &action, NULL);
-  sigaction(SIGINT, &action, NULL);
+  SignalWatcher signals;
+  if (!signals.Add(SIGTERM) || !signals.Add(SIGINT) || !signals.Add(SIGHUP))
+  {
+    LOG4CXX_FATAL(logger, "Failed to setup signal handling!");
+    return 6;
+  }
 
   std::vector<Machine>& machines = config.GetMachines();
   if (machines.empty())
@@ -241,7 +552,7 @@ int main(int argc, char** argv)
 
   LOG4CXX_INFO(logger, "Machines (" << machines.size() << ")");
   for (std::vector<Machine>::const_iterator machine = machines.begin(); machine != machines.end(); ++machine)
-    LOG4CXX_INFO(logger, "\t" << machine->GetName() << ": " << machine->GetMacAddress() << " / " << machine->GetIpAddress() << " (" << machine->GetTimeout() << "s)");
+    LOG4CXX_INFO(logger, "\t" << machine->GetName() << ": " << machine->GetMacAddress() << " / " << machine->GetIpAddress() << " (" << machine->GetTimeout() << "s" << probeDescription(*machine) << ")");
   LOG4CXX_INFO(logger, "");
 
   LOG4CXX_INFO(logger, "Files");
@@ -252,128 +563,313 @@ int main(int argc, char** argv)
     LOG4CXX_INFO(logger, "\tLogging: " << LOGGING_PATH);
   }
   LOG4CXX_INFO(logger, "\tAlways On: " << config.GetAlwaysOnFile());
+  LOG4CXX_INFO(logger, "\tState: " << config.GetStateFile());
+  LOG4CXX_INFO(logger, "\tTrace: " << config.GetTraceFile());
+  LOG4CXX_INFO(logger, "");
+
+  LOG4CXX_INFO(logger, "Metrics");
+  if (config.GetMetricsPort() != 0) {
+    LOG4CXX_INFO(logger, "\tListening: " << config.GetMetricsAddress() << ":" << config.GetMetricsPort());
+  } else {
+    LOG4CXX_INFO(logger, "\tListening: no");
+  }
 
   LOG4CXX_INFO(logger, "");
-  LOG4CXX_INFO(logger, "Monitoring the network for activity..."); 
-  Poco::Timestamp lastPing;
-  Poco::Timestamp lastChange;
-  bool alwaysOn = false;
-  File alwaysOnFile(config.GetAlwaysOnFile());
+  LOG4CXX_INFO(logger, "Monitoring the network for activity...");
+  // shutting a server down happens on a separate thread per server
+  Metrics metrics;
+  Monitor monitor(config, network, metrics);
+  std::vector<int> shutdownDescriptors;
+  monitor.GetShutdownDescriptors(shutdownDescriptors);
+
+  // the metrics are served on their own threads
+  MetricsServer metricsServer(metrics);
+  if (config.GetMetricsPort() != 0 && !metricsServer.Start(config.GetMetricsAddress(), config.GetMetricsPort()))
+    LOG4CXX_WARN(logger, "Failed to serve the metrics on port " << config.GetMetricsPort());
+
+  // pick up where a previous run left off
+  if (!config.GetStateFile().empty() && !monitor.OpenStateFile(config.GetStateFile()))
+    LOG4CXX_WARN(logger, "Failed to open the state file " << config.GetStateFile() << ", the state will not be kept");
+
+  // the trace starts from the restored state
+  if (!config.GetTraceFile().empty() && !monitor.OpenTrace(config.GetTraceFile()))
+    LOG4CXX_WARN(logger, "Failed to open the trace file " << config.GetTraceFile() << ", nothing will be traced");
+
+  // the process only wakes up when a ping round or a deadline is due, the
+  // always on file or the configuration has been touched or a signal has
+  // been received
+  EventLoop eventLoop;
+  Timer pingTimer;
+  Timer deadlineTimer;
+  Poco::Timestamp::TimeDiff pingInterval = static_cast<Poco::Timestamp::TimeDiff>(config.GetPingInterval()) * SECONDS_TO_MICROSECONDS;
+  if (!eventLoop.Add(signals.GetDescriptor(), EventSignal) ||
+      !eventLoop.Add(pingTimer.GetDescriptor(), EventPing) ||
+      !eventLoop.Add(deadlineTimer.GetDescriptor(), EventDeadline) ||
+      !monitor.Start() ||
+      !pingTimer.Start(pingInterval, pingInterval))
+  {
+    LOG4CXX_FATAL(logger, "Failed to setup the event loop!");
+    return 6;
+  }
 
-  while (!abortRequested)
+  for (std::vector<int>::const_iterator descriptor = shutdownDescriptors.begin(); descriptor != shutdownDescriptors.end(); ++descriptor)
   {
-    // check if the always on file exists
-    bool alwaysOnExists = alwaysOnFile.exists();
-    if (alwaysOnExists != alwaysOn)
+    if (!eventLoop.Add(*descriptor, EventShutdown))
     {
-      if (alwaysOnExists) {
-        LOG4CXX_INFO(logger, "Always ON has been enabled");
-      } else {
-        LOG4CXX_INFO(logger, "Always ON has been disabled");
-      }
+      LOG4CXX_FATAL(logger, "Failed to setup the event loop!");
+      return 6;
+    }
+  }
+
+  // the running daemon can be queried and controlled locally
+  ControlSocket control;
+  if (!control.Open(CONTROL_PATH) ||
+      !eventLoop.Add(control.GetDescriptor(), EventControl))
+    LOG4CXX_WARN(logger, "Failed to listen for commands on " << CONTROL_PATH);
+
+  // changes to the configuration are picked up without a restart
+  FileWatcher configWatcher;
+  if (!configWatcher.Watch(configFileLocation) ||
+      !eventLoop.Add(configWatcher.GetDescriptor(), EventConfiguration))
+  {
+    LOG4CXX_FATAL(logger, "Failed to watch " << configFileLocation << "!");
+    return 6;
+  }
+
+  // an always on file which can't be watched (e.g. because its directory
+  // doesn't exist) is treated as not present
+  FileWatcher alwaysOnWatcher;
+  if (!config.GetAlwaysOnFile().empty())
+  {
+    if (!alwaysOnWatcher.Watch(config.GetAlwaysOnFile()))
+      LOG4CXX_WARN(logger, "Failed to watch " << config.GetAlwaysOnFile() << ", treating it as not present");
+    else if (!eventLoop.Add(alwaysOnWatcher.GetDescriptor(), EventAlwaysOn))
+    {
+      LOG4CXX_FATAL(logger, "Failed to watch " << config.GetAlwaysOnFile() << "!");
+      return 6;
+    }
+    else
+      monitor.SetAlwaysOn(alwaysOnWatcher.Exists());
+  }
+
+  // passively listen for machines announcing themselves on the network
+  Sniffer sniffer;
+  if (config.IsNetworkPassive())
+  {
+    if (!sniffer.Open(config.GetNetworkInterface()) ||
+        !eventLoop.Add(sniffer.GetDescriptor(), EventSniffer))
+    {
+      LOG4CXX_FATAL(logger, "Failed to passively monitor " << config.GetNetworkInterface() << "!");
+      return 6;
+    }
+  }
 
-      alwaysOn = alwaysOnExists;
+  // follow the kernel's neighbour table without sending anything
+  NeighbourMonitor neighbours;
+  if (config.IsNetworkNeighbours())
+  {
+    if (!neighbours.Open(config.GetNetworkInterface()) ||
+        !eventLoop.Add(neighbours.GetDescriptor(), EventNeighbours))
+    {
+      LOG4CXX_FATAL(logger, "Failed to monitor the neighbours on " << config.GetNetworkInterface() << "!");
+      return 6;
     }
+  }
 
-    // check if the server is online
-    if (lastPing.elapsed() > config.GetPingInterval() * SECONDS_TO_MICROSECONDS)
+  bool abortRequested = false;
+  bool reloadRequested = false;
+  bool probeRequested = false;
+  std::string command;
+  std::vector<uint32_t> events;
+  std::vector<Sighting> sightings;
+  std::vector<Sighting> losses;
+
+  // periodically sweep the subnets for machines which got a new IP address
+  Discovery discovery;
+  Timer discoveryTimer;
+  if (config.GetDiscoveryInterval() > 0)
+  {
+    for (std::vector<std::string>::const_iterator interface = interfaces.begin(); interface != interfaces.end(); ++interface)
     {
-      lastPing.update();
-      
-      // ping the server
-      std::vector<Machine> servers; servers.push_back(server);
-      std::vector<Machine> serversAvailable = network.Ping(servers, config.GetPingTimeout());
-      // check if the server hasn't been online for a while
-      bool wasServerAvailable = server.IsOnline();
-      if (serversAvailable.empty())
+      if (!discovery.Add(*interface))
+        LOG4CXX_WARN(logger, "Failed to discover machines on " << *interface);
+    }
+
+    const Poco::Timestamp::TimeDiff discoveryInterval = static_cast<Poco::Timestamp::TimeDiff>(config.GetDiscoveryInterval()) * SECONDS_TO_MICROSECONDS;
+    if (discovery.GetSize() > 0)
+    {
+      if (!eventLoop.Add(discoveryTimer.GetDescriptor(), EventDiscovery) ||
+          !eventLoop.Add(discovery.GetDescriptor(), EventDiscoverySweep) ||
+          !discoveryTimer.Start(discoveryInterval, discoveryInterval))
       {
-        if (server.IsOnline())
-        {
-          if (server.GetLastOnline().elapsed() >= server.GetTimeout() * SECONDS_TO_MICROSECONDS)
-            server.SetOnline(false);
-        }
+        LOG4CXX_FATAL(logger, "Failed to setup the discovery timer!");
+        return 6;
       }
-      else
-        server.SetOnline(true);
 
-      if (server.IsOnline() != wasServerAvailable)
+      discover(discovery, config);
+    }
+  }
+  while (!abortRequested)
+  {
+    // the configuration is switched in between two probe rounds
+    if (reloadRequested)
+    {
+      reloadRequested = false;
+
+      for (std::vector<int>::const_iterator descriptor = shutdownDescriptors.begin(); descriptor != shutdownDescriptors.end(); ++descriptor)
+        eventLoop.Remove(*descriptor);
+
+      const std::string metricsAddress = config.GetMetricsAddress();
+      const uint16_t metricsPort = config.GetMetricsPort();
+      const uint16_t pingSeconds = config.GetPingInterval();
+      const uint32_t discoverySeconds = config.GetDiscoveryInterval();
+      if (reloadConfiguration(configFileLocation, config, monitor, network))
       {
-        if (server.IsOnline()) {
-          LOG4CXX_INFO(logger, server.GetName() << " is now available");
-        } else {
-          LOG4CXX_INFO(logger, server.GetName() << " is not available aynmore");
+        if (config.GetMetricsAddress() != metricsAddress || config.GetMetricsPort() != metricsPort)
+        {
+          metricsServer.Stop();
+          if (config.GetMetricsPort() != 0 && !metricsServer.Start(config.GetMetricsAddress(), config.GetMetricsPort()))
+            LOG4CXX_WARN(logger, "Failed to serve the metrics on port " << config.GetMetricsPort());
         }
-      }
 
-      // ping the machines
-      std::vector<Machine> machinesAvailable = network.Ping(machines, config.GetPingTimeout());
-      for (std::vector<Machine>::iterator machine = machines.begin(); machine != machines.end(); ++machine)
-      {
-        std::string machineIp = machine->GetIpAddress();
-        bool available = false;
-        for (std::vector<Machine>::const_iterator machineAvailable = machinesAvailable.begin(); machineAvailable != machinesAvailable.end(); ++machineAvailable)
+        // restarting an unchanged timer would postpone its next round, so
+        // frequent reloads could hold off probing altogether
+        if (config.GetPingInterval() != pingSeconds)
         {
-          if (machineIp.compare(machineAvailable->GetIpAddress()) == 0)
+          pingInterval = static_cast<Poco::Timestamp::TimeDiff>(config.GetPingInterval()) * SECONDS_TO_MICROSECONDS;
+          if (!pingTimer.Start(pingInterval, pingInterval))
           {
-            available = true;
-            break;
+            LOG4CXX_FATAL(logger, "Failed to restart the ping timer!");
+            return 6;
           }
         }
 
-        bool wasAvailable = machine->IsOnline();
-        if (available)
-          machine->SetOnline(true);
-        else
+        if (config.GetDiscoveryInterval() != discoverySeconds && discovery.GetSize() > 0)
         {
-          // check if the machine hasn't been online for a while
-          Poco::Timestamp::TimeDiff elapsed = machine->GetLastOnline().elapsed();
-          if (elapsed >= machine->GetTimeout() * SECONDS_TO_MICROSECONDS)
-            machine->SetOnline(false);
+          const Poco::Timestamp::TimeDiff discoveryInterval = static_cast<Poco::Timestamp::TimeDiff>(config.GetDiscoveryInterval()) * SECONDS_TO_MICROSECONDS;
+          if (!discoveryTimer.Start(discoveryInterval, discoveryInterval))
+          {
+            LOG4CXX_FATAL(logger, "Failed to restart the discovery timer!");
+            return 6;
+          }
         }
+      }
 
-        if (machine->IsOnline() != wasAvailable)
+      monitor.GetShutdownDescriptors(shutdownDescriptors);
+      for (std::vector<int>::const_iterator descriptor = shutdownDescriptors.begin(); descriptor != shutdownDescriptors.end(); ++descriptor)
+      {
+        if (!eventLoop.Add(*descriptor, EventShutdown))
         {
-          if (machine->IsOnline()) {
-            LOG4CXX_INFO(logger, machine->GetName() << " is now available");
-          } else {
-            LOG4CXX_INFO(logger, machine->GetName() << " is not available aynmore");
-          }
+          LOG4CXX_FATAL(logger, "Failed to setup the event loop!");
+          return 6;
         }
       }
     }
 
-    // check if any machine is online
-    bool machineOnline = false;
-    for (std::vector<Machine>::const_iterator machine = machines.begin(); machine != machines.end(); ++machine)
+    monitor.Decide();
+
+    // wake up again when a machine times out or a held off change is due
+    Poco::Timestamp deadline;
+    if (monitor.GetNextDeadline(deadline))
+      deadlineTimer.StartAt(deadline);
+    else
+      deadlineTimer.Stop();
+
+    if (!eventLoop.Wait(events))
     {
-      if (machine->IsOnline())
-      {
-        machineOnline = true;
-        break;
-      }
+      LOG4CXX_FATAL(logger, "Failed to wait for events!");
+      return 6;
     }
+    metrics.GetLoopWakeups().Increment();
 
-    if (alwaysOn || lastChange.elapsed() >= CHANGE_TIMEOUT * SECONDS_TO_MICROSECONDS)
+    for (std::vector<uint32_t>::const_iterator event = events.begin(); event != events.end(); ++event)
     {
-      if ((alwaysOn || machineOnline) && !server.IsOnline())
-      {
-        LOG4CXX_INFO(logger, "Waking up " << server.GetName() << "...");
-        if (network.Wake(server))
-          lastChange.update();
-        else
-          LOG4CXX_ERROR(logger, "Waking up " << server.GetName() << " failed");
-      }
-      else if (!alwaysOn && !machineOnline && server.IsOnline())
+      switch (*event)
       {
-        LOG4CXX_INFO(logger, "Shutting down " << server.GetName() << "...");
-        if (network.Shutdown(server))
-          lastChange.update();
-        else
-          LOG4CXX_ERROR(logger, "Shutting down " << server.GetName() << " failed");
+        case EventSignal:
+        {
+          int signal;
+          while ((signal = signals.Read()) != 0)
+          {
+            if (handleSignal(signal, reloadRequested))
+              abortRequested = true;
+          }
+          break;
+        }
+
+        case EventPing:
+          pingTimer.Acknowledge();
+          monitor.Probe();
+          break;
+
+        case EventDeadline:
+          deadlineTimer.Acknowledge();
+          monitor.Expire();
+          break;
+
+        case EventDiscovery:
+          discoveryTimer.Acknowledge();
+          discover(discovery, config);
+          break;
+
+        // the sweep only sends one batch at a time so that it never holds up
+        // the loop
+        case EventDiscoverySweep:
+          sightings.clear();
+          discovery.Process(sightings);
+          for (std::vector<Sighting>::const_iterator sighting = sightings.begin(); sighting != sightings.end(); ++sighting)
+            monitor.Discovered(*sighting);
+          break;
+
+        case EventAlwaysOn:
+          if (alwaysOnWatcher.Process())
+            monitor.SetAlwaysOn(alwaysOnWatcher.Exists());
+          break;
+
+        case EventSniffer:
+          sightings.clear();
+          sniffer.Process(sightings);
+          for (std::vector<Sighting>::const_iterator sighting = sightings.begin(); sighting != sightings.end(); ++sighting)
+            monitor.Seen(*sighting);
+          break;
+
+        case EventNeighbours:
+          sightings.clear();
+          losses.clear();
+          neighbours.Process(sightings, losses);
+          for (std::vector<Sighting>::const_iterator sighting = sightings.begin(); sighting != sightings.end(); ++sighting)
+            monitor.Seen(*sighting);
+          for (std::vector<Sighting>::const_iterator loss = losses.begin(); loss != losses.end(); ++loss)
+            monitor.Lost(*loss);
+          break;
+
+        case EventShutdown:
+          monitor.ShutdownFinished();
+          break;
+
+        case EventConfiguration:
+          if (configWatcher.Process() && configWatcher.Exists())
+            reloadRequested = true;
+          break;
+
+        case EventControl:
+          while (control.Receive(command))
+            control.Reply(handleCommand(command, monitor, probeRequested));
+          break;
+
+        default:
+          LOG4CXX_WARN(logger, "Unknown event " << *event);
+          break;
       }
     }
 
-    sleep(1);
+    // a requested probe round replaces the next scheduled one
+    if (probeRequested)
+    {
+      probeRequested = false;
+      monitor.Probe(true);
+      pingTimer.Start(pingInterval, pingInterval);
+    }
   }
 
   return 0;